@@ -0,0 +1,175 @@
+/*
+ * bench.c - A benchmark runner that repeats a function until the median
+ *     of its running times is known to a given precision.
+ *
+ * The median and the median absolute deviation (MAD) are used instead of
+ * the mean and the standard deviation because the running times of a
+ * function are skewed: interrupts and page faults only ever add time.
+ * The confidence interval of the median is the distribution-free one
+ * given by the order statistics of the samples.
+ */
+#define _GNU_SOURCE /* for sched_setaffinity() */
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+
+/* The parameters of the runner (see bench.h) */
+static double target = 0.01;
+static int warmup = 3;
+static int min_samples = 10;
+static int max_samples = 1000;
+static double max_secs = 10;
+
+/* z for a two-sided 95% confidence interval */
+#define Z95 1.96
+
+void
+set_bench_target(double target_arg)
+{
+	target = target_arg;
+}
+
+void
+set_bench_warmup(int runs)
+{
+	warmup = runs;
+}
+
+void
+set_bench_samples(int min, int max)
+{
+	min_samples = (min < 1) ? 1 : min;
+	max_samples = (max < min_samples) ? min_samples : max;
+}
+
+void
+set_bench_maxsecs(double secs)
+{
+	max_secs = secs;
+}
+
+/*
+ * now_ns - Read the raw monotonic clock, which NTP does not slew, in ns
+ */
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * insert - Add x to the sorted array a of n values
+ */
+static void
+insert(double *a, int n, double x)
+{
+	int i;
+
+	for (i = n; i > 0 && a[i - 1] > x; i--)
+		a[i] = a[i - 1];
+	a[i] = x;
+}
+
+/*
+ * median - Return the median of the sorted array a of n values
+ */
+static double
+median(const double *a, int n)
+{
+	return (n % 2) ? a[n / 2] : (a[n / 2 - 1] + a[n / 2]) / 2;
+}
+
+/*
+ * interval - Set lo and hi to the 95% confidence interval of the median
+ *     of the sorted array a of n values.  The true median lies between
+ *     the j-th and the k-th smallest samples with 95% probability, by the
+ *     normal approximation of the binomial distribution.  Returns 0 if
+ *     there are too few samples for that, in which case the interval is
+ *     the whole range of the samples.
+ */
+static int
+interval(const double *a, int n, double *lo, double *hi)
+{
+	int j = (int)floor(n / 2.0 - Z95 * sqrt(n) / 2);
+	int k = (int)ceil(1 + n / 2.0 + Z95 * sqrt(n) / 2);
+
+	if (j < 1 || k > n) {
+		*lo = a[0];
+		*hi = a[n - 1];
+		return 0;
+	}
+	*lo = a[j - 1];
+	*hi = a[k - 1];
+	return 1;
+}
+
+/*
+ * bench - Benchmark f(argp), leaving the result in b
+ */
+void
+bench(bench_test_funct f, void *argp, bench_t *b)
+{
+	double *samples, *dev;
+	double start, t, med, lo, hi;
+	cpu_set_t oldmask, mask;
+	int i, n, pinned;
+
+	if ((samples = malloc(max_samples * sizeof(double))) == NULL ||
+	    (dev = malloc(max_samples * sizeof(double))) == NULL) {
+		fprintf(stderr, "bench: out of memory\n");
+		exit(1);
+	}
+
+	/* Keep the scheduler from moving us between samples */
+	pinned = sched_getaffinity(0, sizeof(oldmask), &oldmask) == 0;
+	CPU_ZERO(&mask);
+	CPU_SET(sched_getcpu(), &mask);
+	if (pinned)
+		sched_setaffinity(0, sizeof(mask), &mask);
+
+	for (i = 0; i < warmup; i++)
+		f(argp);
+
+	/* Sample until the median is known well enough */
+	b->converged = 0;
+	start = now_ns();
+	n = 0;
+	do {
+		t = now_ns();
+		f(argp);
+		insert(samples, n++, now_ns() - t);
+		if (n < min_samples)
+			continue;
+		med = median(samples, n);
+		if (interval(samples, n, &lo, &hi) && med - lo <= target * med &&
+		    hi - med <= target * med) {
+			b->converged = 1;
+			break;
+		}
+		if (now_ns() - start >= max_secs * 1e9)
+			break;
+	} while (n < max_samples);
+
+	if (pinned)
+		sched_setaffinity(0, sizeof(oldmask), &oldmask);
+
+	med = median(samples, n);
+	interval(samples, n, &lo, &hi);
+	for (i = 0; i < n; i++)
+		insert(dev, i, fabs(samples[i] - med));
+	b->median = med / 1e9;
+	b->mad = median(dev, n) / 1e9;
+	b->lo = lo / 1e9;
+	b->hi = hi / 1e9;
+	b->samples = n;
+
+	free(samples);
+	free(dev);
+}
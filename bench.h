@@ -0,0 +1,51 @@
+/*
+ * bench.h - A benchmark runner that repeats a function until the median
+ *     of its running times is known to a given precision.
+ *
+ * The runner pins itself to the CPU it is running on, runs the function
+ * a few times to warm up the caches and the heap, and then times single
+ * runs with a nanosecond CLOCK_MONOTONIC_RAW clock.  It stops when the
+ * 95% confidence interval of the median is within the target fraction of
+ * the median, or when it runs out of samples or time.
+ */
+#ifndef __BENCH_H_
+#define __BENCH_H_
+
+typedef void (*bench_test_funct)(void *);
+
+/* The result of a benchmark, in seconds per run */
+typedef struct {
+	double median; /* median running time */
+	double mad;    /* median absolute deviation from the median */
+	double lo, hi; /* 95% confidence interval of the median */
+	int samples;   /* number of timed runs */
+	int converged; /* set if the interval reached the target */
+} bench_t;
+
+/* Benchmark f(argp), leaving the result in b */
+void bench(bench_test_funct f, void *argp, bench_t *b);
+
+/*
+ * set_bench_target - Stop once both ends of the confidence interval are
+ *     within this fraction of the median.  Default = 0.01
+ */
+void set_bench_target(double target);
+
+/*
+ * set_bench_warmup - Number of untimed runs before sampling.  Default = 3
+ */
+void set_bench_warmup(int runs);
+
+/*
+ * set_bench_samples - Take at least min and at most max samples.
+ *     Default = 10, 1000
+ */
+void set_bench_samples(int min, int max);
+
+/*
+ * set_bench_maxsecs - Stop sampling after this many seconds, even if the
+ *     target has not been reached.  Default = 10
+ */
+void set_bench_maxsecs(double secs);
+
+#endif /* __BENCH_H_ */
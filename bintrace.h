@@ -0,0 +1,42 @@
+#ifndef __BINTRACE_H_
+#define __BINTRACE_H_
+
+/*
+ * bintrace.h - the binary trace format read by mdriver and written by
+ *     rep2bin.
+ *
+ * A binary trace is a fixed-size header followed immediately by num_ops
+ * packed traceop_t records.  Both are stored in the native byte order
+ * and layout of the machine that wrote them, so that the driver can
+ * mmap() the file and replay the records in place without parsing.
+ * The header records the record size so that a trace written under a
+ * different ABI is rejected instead of misread.
+ */
+
+#include <stdint.h>
+
+#define BINTRACE_MAGIC	 "MMTRACE" /* includes the terminating NUL */
+#define BINTRACE_VERSION 1
+
+/* The kinds of allocator request in a trace */
+enum { ALLOC, FREE, REALLOC };
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+	uint64_t type : 2;   /* type of request */
+	uint64_t index : 62; /* index for free() to use later */
+	uint64_t size;	     /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* The header at the start of every binary trace file */
+typedef struct {
+	char magic[8];		/* BINTRACE_MAGIC */
+	uint32_t version;	/* BINTRACE_VERSION */
+	uint32_t op_size;	/* sizeof(traceop_t) of the writer */
+	uint64_t sugg_heapsize; /* suggested heap size (unused) */
+	uint64_t num_ids;	/* number of alloc/realloc ids */
+	uint64_t num_ops;	/* number of traceop_t records that follow */
+	uint64_t weight;	/* weight for this trace (unused) */
+} bintrace_hdr_t;
+
+#endif /* __BINTRACE_H_ */
@@ -1,6 +1,6 @@
 /*
- * clock.c - Routines for using the cycle counters on x86,
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
+ *           AArch64, Alpha, and Sparc boxes.
  *
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -8,16 +8,22 @@
 
 #include <sys/times.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
 #include "clock.h"
 
 /*******************************************************
  * Machine dependent functions
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__, __aarch64__, and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
@@ -74,6 +80,105 @@ get_counter()
 }
 /* $end x86cyclecounter */
 
+/* Return the current value of the cycle counter. */
+uint64_t
+read_counter(void)
+{
+	unsigned hi, lo;
+
+	access_counter(&hi, &lo);
+	return ((uint64_t)hi << 32) | lo;
+}
+
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+static uint64_t cyc_start = 0;
+
+/*
+ * Return the time stamp counter.  rdtscp does not read the counter until
+ * every earlier instruction has executed, and the lfence keeps later
+ * instructions from starting before it has, so the measured region is
+ * exactly the code between two reads.
+ */
+static inline uint64_t
+access_counter(void)
+{
+	uint32_t hi, lo, aux;
+
+	__asm__ __volatile__("rdtscp; lfence"
+			     : "=a"(lo), "=d"(hi), "=c"(aux)
+			     : /* No input */
+			     : "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void
+start_counter()
+{
+	cyc_start = access_counter();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double
+get_counter()
+{
+	return (double)(access_counter() - cyc_start);
+}
+
+/* Return the current value of the counter. */
+uint64_t
+read_counter(void)
+{
+	return access_counter();
+}
+
+#elif defined(__aarch64__)
+/*******************************************************
+ * AArch64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+static uint64_t cyc_start = 0;
+
+/*
+ * Return the virtual count of the generic timer.  It ticks at the
+ * constant rate in cntfrq_el0 rather than at the CPU clock rate, which
+ * mhz() reports instead.  The isb keeps the read from being hoisted
+ * above earlier instructions.
+ */
+static inline uint64_t
+access_counter(void)
+{
+	uint64_t v;
+
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(v) : : "memory");
+	return v;
+}
+
+/* Record the current value of the cycle counter. */
+void
+start_counter()
+{
+	cyc_start = access_counter();
+}
+
+/* Return the number of counter ticks since the last start_counter. */
+double
+get_counter()
+{
+	return (double)(access_counter() - cyc_start);
+}
+
+/* Return the current value of the counter. */
+uint64_t
+read_counter(void)
+{
+	return access_counter();
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -134,6 +239,12 @@ get_counter()
 	return result;
 }
 
+uint64_t
+read_counter(void)
+{
+	return counter();
+}
+
 #else
 
 /****************************************************************
@@ -163,6 +274,16 @@ get_counter()
 	printf("Please choose another timing package in config.h.\n");
 	exit(1);
 }
+
+uint64_t
+read_counter(void)
+{
+	printf(
+	    "ERROR: You are trying to use a read_counter routine in clock.c\n");
+	printf("that has not been implemented yet on this platform.\n");
+	printf("Please choose another timing package in config.h.\n");
+	exit(1);
+}
 #endif
 
 /*******************************
@@ -199,11 +320,94 @@ mhz_full(int verbose, int sleeptime)
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* How long mhz_calibrate() watches the counter (ns) */
+#define CALIBRATE_NS 50000000
+
+/*
+ * Estimate the counter rate against CLOCK_MONOTONIC_RAW, which, unlike
+ * sleeping, takes a fraction of a second and is not thrown off by the
+ * scheduler waking us late.
+ */
+static double
+mhz_calibrate(void)
+{
+	struct timespec start, now;
+	double cycles;
+	long ns;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	start_counter();
+	do {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		ns = (now.tv_sec - start.tv_sec) * 1000000000L +
+		    (now.tv_nsec - start.tv_nsec);
+	} while (ns < CALIBRATE_NS);
+	cycles = get_counter();
+	return cycles / (ns / 1e3);
+}
+
+/*
+ * Return the rate of the counter in MHz, as reported by the hardware, or
+ * 0 if the hardware doesn't say.
+ */
+static double
+mhz_detect(int verbose)
+{
+#if defined(__x86_64__)
+	unsigned a, b, c, d;
+
+	/* Without an invariant TSC, the rate follows the CPU clock. */
+	if (!__get_cpuid(0x80000007, &a, &b, &c, &d) || !(d & (1 << 8))) {
+		if (verbose)
+			printf("Warning: the TSC is not invariant\n");
+		return 0;
+	}
+
+	/* Leaf 0x15: TSC = crystal clock * EBX / EAX. */
+	if (__get_cpuid_count(0x15, 0, &a, &b, &c, &d) && a != 0 && b != 0 &&
+	    c != 0)
+		return (double)c * b / a / 1e6;
+
+	/* Hypervisors that report the TSC rate do so in kHz. */
+	__get_cpuid(1, &a, &b, &c, &d);
+	if (c & (1u << 31)) {
+		__cpuid(0x40000000, a, b, c, d);
+		if (a >= 0x40000010) {
+			__cpuid(0x40000010, a, b, c, d);
+			if (a != 0)
+				return a / 1e3;
+		}
+	}
+	return 0;
+#elif defined(__aarch64__)
+	uint64_t freq;
+
+	(void)verbose;
+	__asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+	return freq / 1e6;
+#else
+	(void)verbose;
+	return 0;
+#endif
+}
+
+/*
+ * Determine the counter rate, from the hardware if it reports it and
+ * otherwise by a short calibration.  The result is cached.
+ */
 double
 mhz(int verbose)
 {
-	return mhz_full(verbose, 2);
+	static double rate = 0;
+
+	if (rate == 0) {
+		rate = mhz_detect(verbose);
+		if (rate == 0)
+			rate = mhz_calibrate();
+		if (verbose)
+			printf("Processor clock rate ~= %.1f MHz\n", rate);
+	}
+	return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
@@ -1,15 +1,20 @@
 /* Routines for using cycle counter */
 
+#include <stdint.h>
+
 /* Start the counter */
 void start_counter();
 
 /* Get # cycles since counter started */
 double get_counter();
 
+/* Read the counter itself, for timing many short intervals */
+uint64_t read_counter(void);
+
 /* Measure overhead for counter */
 double ovhd();
 
-/* Determine clock rate of processor (using a default sleeptime) */
+/* Determine the counter rate in MHz (from the hardware if it reports it) */
 double mhz(int verbose);
 
 /* Determine clock rate of processor, having more control over accuracy */
@@ -34,7 +34,8 @@
  * contribution of throughput to the performance index. Once the
  * students surpass the AVG_LIBC_THRUPUT, they get no further benefit
  * to their score.  This deters students from building extremely fast,
- * but extremely stupid malloc packages.
+ * but extremely stupid malloc packages.  "mdriver -L" measures the libc
+ * malloc package on the same traces and uses its throughput instead.
  */
 #define AVG_LIBC_THRUPUT 58500E3 /* 58,500 Kops/sec */
 
@@ -51,15 +52,24 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes.  The heap is reserved address space that is
+ * only committed as it grows, so "mdriver -M" can raise this as far as the
+ * address space allows.
  */
 #define MAX_HEAP (20 * (1 << 20)) /* 20 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0 /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__) || \
+    defined(__alpha)
+#define USE_FCYC   1 /* cycle counter w/K-best scheme (see clock.c) */
+#define USE_ITIMER 0 /* interval timer (any Unix box) */
+#define USE_GETTOD 0 /* gettimeofday (any Unix box) */
+#else
+#define USE_FCYC   0 /* cycle counter w/K-best scheme (see clock.c) */
 #define USE_ITIMER 0 /* interval timer (any Unix box) */
 #define USE_GETTOD 1 /* gettimeofday (any Unix box) */
+#endif
 
 #endif /* __CONFIG_H */
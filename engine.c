@@ -0,0 +1,44 @@
+/*
+ * engine.c - The table of malloc packages that mdriver can evaluate
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+
+/* The package in mm.c */
+const engine_t mm_engine = { "mm", "segregated fits (mm.c)", mm_init,
+	mm_malloc, mm_free, mm_realloc, mm_checkheap, mm_heapwalk, 1 };
+
+/* The textbook package in mm_implicit.c */
+extern const engine_t implicit_engine;
+
+/* The package in mm.c built with 32-bit words (-DMM_COMPACT) */
+extern const engine_t compact_engine;
+
+/* The C library's package */
+static int
+libc_init(void)
+{
+	return (0);
+}
+
+const engine_t libc_engine = { "libc", "the C library's malloc",
+	libc_init, malloc, free, realloc, NULL, NULL, 0 };
+
+const engine_t *engines[] = { &mm_engine, &compact_engine,
+	&implicit_engine, &libc_engine, NULL };
+
+/*
+ * find_engine - Return the engine called name, or NULL
+ */
+const engine_t *
+find_engine(const char *name)
+{
+	int i;
+
+	for (i = 0; engines[i] != NULL; i++)
+		if (!strcmp(engines[i]->name, name))
+			return (engines[i]);
+	return (NULL);
+}
@@ -0,0 +1,47 @@
+/*
+ * engine.h - The malloc packages that mdriver can evaluate
+ *
+ * Each package is an engine: a table of its entry points.  mdriver
+ * replays the traces through whichever engines are selected with -e, so
+ * that several packages can be compared in one run of one binary.
+ */
+#ifndef __ENGINE_H_
+#define __ENGINE_H_
+
+#include <stddef.h>
+
+#include "mm.h"
+
+typedef struct {
+	const char *name; /* what -e calls it */
+	const char *desc; /* one line for the list of engines */
+	int (*init)(void);
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+
+	/* Heap inspection, or NULL if the package has none */
+	int (*checkheap)(int verbose);
+	void (*heapwalk)(mm_visit_t visit, void *arg);
+
+	/*
+	 * Set if the package allocates from memlib's heap, so that its
+	 * payloads can be checked against the heap and its utilization
+	 * measured.  Other packages are only timed.
+	 */
+	int checked;
+} engine_t;
+
+/* The engines, in the order that "-e all" runs them, ending in NULL */
+extern const engine_t *engines[];
+
+/* The segregated-fit package in mm.c, which mdriver scores by default */
+extern const engine_t mm_engine;
+
+/* The C library's package, which mdriver -l compares mm with */
+extern const engine_t libc_engine;
+
+/* Returns the engine called name, or NULL */
+const engine_t *find_engine(const char *name);
+
+#endif /* __ENGINE_H_ */
@@ -135,7 +135,13 @@ double
 fcyc(test_funct f, void *argp)
 {
 	double result;
+	int tries = 0;
 	init_sampler();
+	/*
+	 * A sample that is not positive is not a time (compensation took out
+	 * more than the run took), and K-best would keep it as the smallest.
+	 * Drop it, but still count it against maxsamples.
+	 */
 	if (compensate) {
 		do {
 			double cyc;
@@ -144,8 +150,9 @@ fcyc(test_funct f, void *argp)
 			start_comp_counter();
 			f(argp);
 			cyc = get_comp_counter();
-			add_sample(cyc);
-		} while (!has_converged() && samplecount < maxsamples);
+			if (cyc > 0)
+				add_sample(cyc);
+		} while (!has_converged() && ++tries < maxsamples);
 	} else {
 		do {
 			double cyc;
@@ -154,8 +161,16 @@ fcyc(test_funct f, void *argp)
 			start_counter();
 			f(argp);
 			cyc = get_counter();
-			add_sample(cyc);
-		} while (!has_converged() && samplecount < maxsamples);
+			if (cyc > 0)
+				add_sample(cyc);
+		} while (!has_converged() && ++tries < maxsamples);
+	}
+	if (samplecount == 0 && compensate) {
+		/* Every compensated sample was bogus, so time without it */
+		compensate = 0;
+		result = fcyc(f, argp);
+		compensate = 1;
+		return result;
 	}
 #ifdef DEBUG
 	{
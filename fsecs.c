@@ -3,14 +3,21 @@
  ****************************/
 #include <stdio.h>
 
+#include "bench.h"
 #include "clock.h"
 #include "config.h"
 #include "fcyc.h"
 #include "fsecs.h"
 #include "ftimer.h"
+#include "perfctr.h"
 
 static double Mhz; /* estimated CPU clock frequency */
 
+/* Hardware counters to run around each timed call (see fsecs_counters) */
+static perfctr_t *counters = NULL;
+static fsecs_test_funct counted_f; /* the function being counted */
+static int counted_runs;	   /* the number of times it has run */
+
 extern int verbose; /* -v option in mdriver.c */
 
 /*
@@ -28,7 +35,15 @@ init_fsecs(void)
 	/* set key parameters for the fcyc package */
 	set_fcyc_maxsamples(20);
 	set_fcyc_clear_cache(1);
+#if defined(__i386__) || defined(__alpha)
+	/*
+	 * Only these counters tick with the CPU under a periodic timer,
+	 * which is what the compensation assumes.  The invariant TSC and
+	 * the AArch64 generic timer run on through the interrupt, and on a
+	 * tickless kernel times() does not count it.
+	 */
 	set_fcyc_compensate(1);
+#endif
 	set_fcyc_epsilon(0.01);
 	set_fcyc_k(3);
 	Mhz = mhz(verbose > 0);
@@ -41,18 +56,83 @@ init_fsecs(void)
 #endif
 }
 
+/*
+ * fsecs_counters - Count hardware events during the timed runs of later
+ *     calls to fsecs, leaving the average count per run in pc->counts.
+ *     pc must have been opened with perfctr_open; NULL turns counting off.
+ */
+void
+fsecs_counters(perfctr_t *pc)
+{
+	counters = pc;
+}
+
+/*
+ * counted - Run the function being timed with the counters enabled
+ */
+static void
+counted(void *argp)
+{
+	perfctr_enable();
+	counted_f(argp);
+	perfctr_disable();
+	counted_runs++;
+}
+
+/*
+ * count_begin - Start counting the runs of f, if there are counters.
+ *     Returns the function to time in place of f.
+ */
+static fsecs_test_funct
+count_begin(fsecs_test_funct f)
+{
+	if (counters == NULL)
+		return f;
+	counted_f = f;
+	counted_runs = 0;
+	perfctr_begin(counters);
+	return counted;
+}
+
+/*
+ * count_end - Stop counting, leaving the count per run in the counters
+ */
+static void
+count_end(void)
+{
+	if (counters != NULL)
+		perfctr_end(counters, counted_runs);
+}
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
 double
 fsecs(fsecs_test_funct f, void *argp)
 {
+	double secs;
+
+	f = count_begin(f);
 #if USE_FCYC
-	double cycles = fcyc(f, argp);
-	return cycles / (Mhz * 1e6);
+	secs = fcyc(f, argp) / (Mhz * 1e6);
 #elif USE_ITIMER
-	return ftimer_itimer(f, argp, 10);
+	secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-	return ftimer_gettod(f, argp, 10);
+	secs = ftimer_gettod(f, argp, 10);
 #endif
+	count_end();
+	return secs;
+}
+
+/*
+ * fsecs_bench - Return the median running time of a function f (in
+ *     seconds), as measured by the benchmark runner, which leaves the
+ *     rest of its statistics in b
+ */
+double
+fsecs_bench(fsecs_test_funct f, void *argp, bench_t *b)
+{
+	bench(count_begin(f), argp, b);
+	count_end();
+	return b->median;
 }
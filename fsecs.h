@@ -1,4 +1,9 @@
+#include "bench.h"
+#include "perfctr.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
+void fsecs_counters(perfctr_t *pc);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_bench(fsecs_test_funct f, void *argp, bench_t *b);
@@ -0,0 +1,257 @@
+/*
+ * heapmap.c - Analyze a heap snapshot written by "mdriver -S".
+ *
+ * Usage: heapmap [-h] [-r <rows>] [-w <cols>] <snapshot>
+ *
+ * Prints a summary of the heap, a map of how much of each stretch of the
+ * heap is allocated, and histograms of the free blocks by size and by
+ * the free-list class that the mm package put them in.  The map shows
+ * where free space is scattered between allocated blocks, and the
+ * histograms whether it is in blocks too small to be reused.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#define DEFAULT_COLS 64	  /* cells per row of the map */
+#define DEFAULT_ROWS 24	  /* max rows of the map */
+#define BATCH_RECS   4096 /* records read at a time */
+#define SIZE_BUCKETS 48	  /* power-of-two size buckets */
+#define MAX_CLASSES  (1 << 15)
+#define BAR_WIDTH    40 /* width of the longest histogram bar */
+
+/* Map cells, from empty to fully allocated */
+static const char levels[] = " .:-=+*#";
+#define NLEVELS ((int)sizeof(levels) - 1)
+
+/* The free blocks in one histogram bucket */
+typedef struct {
+	uint64_t blocks;
+	uint64_t bytes;
+	uint64_t min, max;
+} bucket_t;
+
+static bucket_t by_size[SIZE_BUCKETS];
+static bucket_t by_class[MAX_CLASSES];
+
+static void
+unix_error(const char *msg, const char *path)
+{
+	fprintf(stderr, "heapmap: %s %s: %s\n", msg, path, strerror(errno));
+	exit(1);
+}
+
+static void
+app_error(const char *msg, const char *path)
+{
+	fprintf(stderr, "heapmap: %s: %s\n", path, msg);
+	exit(1);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "Usage: heapmap [-h] [-r <rows>] [-w <cols>] <snapshot>\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-r <rows>  Draw the map in at most <rows> rows.\n");
+	fprintf(stderr, "\t-w <cols>  Draw the map <cols> cells wide.\n");
+}
+
+/*
+ * add_bucket - Count a free block in a histogram bucket
+ */
+static void
+add_bucket(bucket_t *b, uint64_t size)
+{
+	if (b->blocks == 0 || size < b->min)
+		b->min = size;
+	if (size > b->max)
+		b->max = size;
+	b->blocks++;
+	b->bytes += size;
+}
+
+/*
+ * print_bar - Print a bar for a histogram bucket of "bytes" bytes
+ */
+static void
+print_bar(uint64_t bytes, uint64_t most)
+{
+	int i, n = (most > 0) ? (int)((bytes * BAR_WIDTH + most - 1) / most) :
+				0;
+
+	printf("  ");
+	for (i = 0; i < n; i++)
+		putchar('#');
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *fp;
+	snapshot_hdr_t hdr;
+	static snapshot_rec_t recs[BATCH_RECS];
+	uint64_t *cells;
+	uint64_t ncells, cellsize, lo, hi, start, end, i, most;
+	uint64_t nalloc = 0, alloc_bytes = 0, nfree = 0, free_bytes = 0;
+	uint64_t largest = 0;
+	size_t n, j;
+	int cols = DEFAULT_COLS, rows = DEFAULT_ROWS;
+	int c, k, level;
+
+	while ((c = getopt(argc, argv, "r:w:h")) != EOF) {
+		switch (c) {
+		case 'r': /* Max rows of the map */
+			rows = atoi(optarg);
+			break;
+		case 'w': /* Width of the map */
+			cols = atoi(optarg);
+			break;
+		case 'h': /* Print this message */
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind != argc - 1 || rows < 1 || cols < 1) {
+		usage();
+		exit(1);
+	}
+
+	if ((fp = fopen(argv[optind], "r")) == NULL)
+		unix_error("could not open", argv[optind]);
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+		app_error("not a heap snapshot", argv[optind]);
+	if (hdr.version != SNAPSHOT_VERSION ||
+	    hdr.rec_size != sizeof(snapshot_rec_t))
+		app_error("snapshot was written by an incompatible mdriver",
+		    argv[optind]);
+
+	/*
+	 * Each cell of the map covers cellsize bytes of the heap's span, which
+	 * includes any gaps between its segments
+	 */
+	cellsize = (hdr.span + (uint64_t)cols * rows - 1) /
+	    ((uint64_t)cols * rows);
+	cellsize = (cellsize < 1) ? 1 : cellsize;
+	ncells = (hdr.span + cellsize - 1) / cellsize;
+	if ((cells = calloc(ncells + 1, sizeof(uint64_t))) == NULL)
+		app_error("out of memory", argv[optind]);
+
+	/* Read the blocks, adding up the allocated bytes in each cell */
+	i = 0;
+	while (i < hdr.nblocks &&
+	    (n = fread(recs, sizeof(snapshot_rec_t), BATCH_RECS, fp)) > 0) {
+		for (j = 0; j < n && i < hdr.nblocks; j++, i++) {
+			if (!recs[j].alloc) {
+				nfree++;
+				free_bytes += recs[j].size;
+				if (recs[j].size > largest)
+					largest = recs[j].size;
+				for (k = 0; k < SIZE_BUCKETS - 1 &&
+				     recs[j].size >= (uint64_t)2 << k;
+				     k++)
+					;
+				add_bucket(&by_size[k], recs[j].size);
+				add_bucket(&by_class[recs[j].cls], recs[j].size);
+				continue;
+			}
+			nalloc++;
+			alloc_bytes += recs[j].size;
+			lo = recs[j].offset;
+			hi = lo + recs[j].size;
+			hi = (hi > hdr.span) ? hdr.span : hi;
+			for (start = lo; start < hi; start = end) {
+				end = (start / cellsize + 1) * cellsize;
+				end = (end > hi) ? hi : end;
+				cells[start / cellsize] += end - start;
+			}
+		}
+	}
+	fclose(fp);
+	if (i != hdr.nblocks)
+		app_error("snapshot is truncated", argv[optind]);
+
+	/* The summary */
+	printf("%s: trace %d after request %" PRIu64 "\n", argv[optind],
+	    hdr.tracenum, hdr.opnum);
+	printf("heap %" PRIu64 " bytes in %" PRIu64 " blocks", hdr.heapsize,
+	    hdr.nblocks);
+	if (hdr.span > hdr.heapsize)
+		printf(", in segments spanning %" PRIu64 " bytes", hdr.span);
+	printf("\n");
+	printf("  allocated %8" PRIu64 " blocks %10" PRIu64
+	       " bytes (payload %" PRIu64 ", %.1f%%)\n",
+	    nalloc, alloc_bytes, hdr.live,
+	    alloc_bytes ? 100.0 * hdr.live / alloc_bytes : 0.0);
+	printf("  free      %8" PRIu64 " blocks %10" PRIu64
+	       " bytes (largest %" PRIu64 ")\n",
+	    nfree, free_bytes, largest);
+	printf("  other     %26" PRIu64 " bytes\n",
+	    hdr.seg_bytes - alloc_bytes - free_bytes);
+	if (hdr.heapsize > hdr.seg_bytes)
+		printf("  elsewhere %26" PRIu64
+		       " bytes (allocator tables, or space released since "
+		       "the peak)\n",
+		    hdr.heapsize - hdr.seg_bytes);
+	printf("\n");
+
+	/* The map */
+	printf("Occupancy map, %" PRIu64
+	       " bytes per cell (' ' free to '#' allocated):\n",
+	    cellsize);
+	for (i = 0; i < ncells; i++) {
+		if (i % cols == 0)
+			printf("%10" PRIu64 " |", i * cellsize);
+		end = (i + 1) * cellsize;
+		end = (end > hdr.span) ? hdr.span - i * cellsize : cellsize;
+		level = (cells[i] == 0) ?
+		    0 :
+		    1 + (int)((cells[i] * (NLEVELS - 1) - 1) / end);
+		putchar(levels[(level < NLEVELS) ? level : NLEVELS - 1]);
+		if (i % cols == (uint64_t)cols - 1 || i == ncells - 1)
+			printf("|\n");
+	}
+
+	/* The histograms */
+	for (most = 0, k = 0; k < SIZE_BUCKETS; k++)
+		most = (by_size[k].bytes > most) ? by_size[k].bytes : most;
+	printf("\nFree blocks by size:\n");
+	printf("%22s%10s%12s\n", "size", "blocks", "bytes");
+	for (k = 0; k < SIZE_BUCKETS; k++) {
+		if (by_size[k].blocks == 0)
+			continue;
+		printf("%10" PRIu64 " - %-9" PRIu64 "%10" PRIu64 "%12" PRIu64,
+		    (k == 0) ? 0 : (uint64_t)1 << k, ((uint64_t)2 << k) - 1,
+		    by_size[k].blocks, by_size[k].bytes);
+		print_bar(by_size[k].bytes, most);
+	}
+
+	for (most = 0, k = 0; k < MAX_CLASSES; k++)
+		most = (by_class[k].bytes > most) ? by_class[k].bytes : most;
+	printf("\nFree blocks by free-list class:\n");
+	printf("%6s%10s%12s%10s%10s\n", "class", "blocks", "bytes", "min",
+	    "max");
+	for (k = 0; k < MAX_CLASSES; k++) {
+		if (by_class[k].blocks == 0)
+			continue;
+		printf("%6d%10" PRIu64 "%12" PRIu64 "%10" PRIu64 "%10" PRIu64,
+		    k, by_class[k].blocks, by_class[k].bytes, by_class[k].min,
+		    by_class[k].max);
+		print_bar(by_class[k].bytes, most);
+	}
+
+	free(cells);
+	return (0);
+}
@@ -0,0 +1,71 @@
+/*
+ * lathist.c - Log-linear histograms of per-operation latencies
+ */
+#include <string.h>
+
+#include "lathist.h"
+
+/*
+ * bucket_high - Return the largest value that falls in bucket i
+ */
+static uint64_t
+bucket_high(int i)
+{
+	int shift;
+	uint64_t mantissa;
+
+	if (i < LATHIST_SUB)
+		return i;
+	shift = i / LATHIST_SUB - 1;
+	mantissa = LATHIST_SUB + i % LATHIST_SUB;
+	return ((mantissa + 1) << shift) - 1;
+}
+
+/*
+ * lathist_reset - Empty a histogram
+ */
+void
+lathist_reset(lathist_t *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+/*
+ * lathist_merge - Add the values recorded in src to dst
+ */
+void
+lathist_merge(lathist_t *dst, const lathist_t *src)
+{
+	int i;
+
+	dst->count += src->count;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	for (i = 0; i < LATHIST_NBUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+/*
+ * lathist_percentile - Return the value below which pct percent of the
+ *     recorded values fall, rounded up to the top of its bucket but never
+ *     above the largest value recorded.  Returns 0 for an empty histogram.
+ */
+uint64_t
+lathist_percentile(const lathist_t *h, double pct)
+{
+	uint64_t rank, seen = 0, high;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+	rank = (rank < 1) ? 1 : rank;
+	for (i = 0; i < LATHIST_NBUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			high = bucket_high(i);
+			return (high < h->max) ? high : h->max;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,48 @@
+/*
+ * lathist.h - Log-linear histograms of per-operation latencies, in ticks
+ *     of clock.c's read_counter().
+ *
+ * Values below LATHIST_SUB are counted exactly.  Above that, every power
+ * of two is split into LATHIST_SUB equal buckets, so a percentile read
+ * back from the histogram is within 1/LATHIST_SUB of the true value.
+ */
+#ifndef __LATHIST_H_
+#define __LATHIST_H_
+
+#include <stdint.h>
+
+#define LATHIST_SUB_BITS 4
+#define LATHIST_SUB	 (1 << LATHIST_SUB_BITS)
+#define LATHIST_NBUCKETS ((64 - LATHIST_SUB_BITS + 1) * LATHIST_SUB)
+
+typedef struct {
+	uint64_t count;			     /* number of values recorded */
+	uint64_t max;			     /* largest value recorded */
+	uint64_t buckets[LATHIST_NBUCKETS]; /* counts by bucket */
+} lathist_t;
+
+/*
+ * lathist_add - Record one value
+ */
+static inline void
+lathist_add(lathist_t *h, uint64_t v)
+{
+	int msb, shift;
+
+	h->count++;
+	if (v > h->max)
+		h->max = v;
+	if (v < LATHIST_SUB) {
+		h->buckets[v]++;
+		return;
+	}
+	msb = 63 - __builtin_clzll(v);
+	shift = msb - LATHIST_SUB_BITS;
+	h->buckets[(shift + 1) * LATHIST_SUB + (v >> shift) - LATHIST_SUB]++;
+}
+
+void lathist_reset(lathist_t *h);
+void lathist_merge(lathist_t *dst, const lathist_t *src);
+uint64_t lathist_percentile(const lathist_t *h, double pct);
+
+#endif /* __LATHIST_H_ */
@@ -0,0 +1,495 @@
+/*
+ * mbench.c - Microbenchmarks for the individual paths of the mm malloc
+ *     package.
+ *
+ * Usage: mbench [-h] [-H <pages>] [-k <kernel>] [-n <count>] [-r <reps>]
+ *               [-s <size>]
+ *
+ * Each kernel sets up the heap so that the requests it times all take
+ * the same path through mm.c, then reports the time per request in ns
+ * and in cycles (of the counter in clock.c).  The fastest of several
+ * repetitions is reported.  Run every kernel to get a fingerprint of
+ * the package, or one kernel to study one path.  Compare a run with -H
+ * to one without to see what the TLB misses of the heap cost each path.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "memlib.h"
+#include "mm.h"
+
+#define DEFAULT_COUNT 10000 /* requests timed per repetition */
+#define DEFAULT_REPS  5	    /* repetitions; the fastest is reported */
+#define DEFAULT_SIZE  64    /* payload size of the kernels' blocks */
+#define PAIRS_MAXSIZE 16384 /* largest size class swept by "pairs" */
+#define EXTEND_SIZE   8192  /* payload size that always extends the heap */
+#define BLOCK_OVHD    32    /* bytes allowed per block for mm's overhead */
+
+/* The time that one repetition of a kernel spent in its timed phase */
+typedef struct {
+	struct timespec start; /* when the timed phase started */
+	double ns;	       /* its length in ns */
+	double cycles;	       /* its length in cycles */
+} timing_t;
+
+/*
+ * A kernel: run the requests once, returning how many were timed.  It
+ * holds up to count * footprint blocks of size bytes at once, or next to
+ * nothing if footprint is 0.
+ */
+typedef struct {
+	const char *name;
+	long (*run)(size_t size, long count, char **blocks, timing_t *t);
+	int footprint;
+	const char *desc;
+} kernel_t;
+
+static long pairs(size_t size, long count, char **blocks, timing_t *t);
+static long free_lifo(size_t size, long count, char **blocks, timing_t *t);
+static long free_fifo(size_t size, long count, char **blocks, timing_t *t);
+static long free_random(size_t size, long count, char **blocks,
+    timing_t *t);
+static long coalesce_both(size_t size, long count, char **blocks,
+    timing_t *t);
+static long realloc_grow(size_t size, long count, char **blocks,
+    timing_t *t);
+static long realloc_shrink(size_t size, long count, char **blocks,
+    timing_t *t);
+static long extend(size_t size, long count, char **blocks, timing_t *t);
+static long scan(size_t size, long count, char **blocks, timing_t *t);
+
+static const kernel_t kernels[] = {
+	{ "pairs", pairs, 0, "mm_malloc then mm_free, per size class" },
+	{ "lifo", free_lifo, 1, "mm_free of blocks, newest first" },
+	{ "fifo", free_fifo, 1, "mm_free of blocks, oldest first" },
+	{ "random", free_random, 1, "mm_free of blocks, in random order" },
+	{ "coalesce", coalesce_both, 1, "mm_free between two free blocks" },
+	{ "realloc", realloc_grow, 2, "mm_realloc growing a block by size" },
+	{ "shrink", realloc_shrink, 1,
+	    "mm_realloc shrinking a block by size" },
+	{ "extend", extend, 1, "mm_malloc that extends the heap" },
+	{ "scan", scan, 2, "mm_malloc past <count> free blocks too small" },
+};
+#define NKERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static void usage(void);
+static void app_error(char *msg);
+
+/*
+ * start_timing - Start the timed phase of a kernel
+ */
+static void
+start_timing(timing_t *t)
+{
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t->start);
+	start_counter();
+}
+
+/*
+ * stop_timing - End the timed phase of a kernel
+ */
+static void
+stop_timing(timing_t *t)
+{
+	struct timespec end;
+
+	t->cycles = get_counter();
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+	t->ns = (end.tv_sec - t->start.tv_sec) * 1e9 +
+	    (end.tv_nsec - t->start.tv_nsec);
+}
+
+/*
+ * heap_init - Start a kernel with an empty heap
+ */
+static void
+heap_init(void)
+{
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed");
+}
+
+/*
+ * alloc - Allocate a block for a kernel
+ */
+static char *
+alloc(size_t size)
+{
+	char *p;
+
+	if ((p = mm_malloc(size)) == NULL)
+		app_error("mm_malloc failed");
+	return p;
+}
+
+/*
+ * pairs - Allocate and immediately free a block of one size, which
+ *     exercises find_fit() and place() on a warm free list, and case 1 or
+ *     2 of coalesce()
+ */
+static long
+pairs(size_t size, long count, char **blocks, timing_t *t)
+{
+	long i;
+
+	(void)blocks;
+	heap_init();
+	mm_free(alloc(size));
+	start_timing(t);
+	for (i = 0; i < count; i++)
+		mm_free(alloc(size));
+	stop_timing(t);
+	return 2 * count;
+}
+
+/*
+ * fill - Allocate count blocks of the given size, one after another.
+ *     The last block is followed by a guard, so that no free in the
+ *     timed phase of a kernel merges with the rest of the heap.
+ */
+static void
+fill(size_t size, long count, char **blocks)
+{
+	long i;
+
+	heap_init();
+	for (i = 0; i < count; i++)
+		blocks[i] = alloc(size);
+	alloc(size);
+}
+
+/*
+ * free_lifo - Free the blocks newest first, so every free merges with the
+ *     free block after it: case 2 of coalesce()
+ */
+static long
+free_lifo(size_t size, long count, char **blocks, timing_t *t)
+{
+	long i;
+
+	fill(size, count, blocks);
+	start_timing(t);
+	for (i = count - 1; i >= 0; i--)
+		mm_free(blocks[i]);
+	stop_timing(t);
+	return count;
+}
+
+/*
+ * free_fifo - Free the blocks oldest first, so every free merges with the
+ *     free block before it: case 3 of coalesce()
+ */
+static long
+free_fifo(size_t size, long count, char **blocks, timing_t *t)
+{
+	long i;
+
+	fill(size, count, blocks);
+	start_timing(t);
+	for (i = 0; i < count; i++)
+		mm_free(blocks[i]);
+	stop_timing(t);
+	return count;
+}
+
+/*
+ * free_random - Free the blocks in a random order, which mixes all four
+ *     cases of coalesce() and scatters the free-list updates
+ */
+static long
+free_random(size_t size, long count, char **blocks, timing_t *t)
+{
+	long i, j;
+	char *tmp;
+
+	fill(size, count, blocks);
+	srand(1);
+	for (i = count - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		tmp = blocks[i];
+		blocks[i] = blocks[j];
+		blocks[j] = tmp;
+	}
+	start_timing(t);
+	for (i = 0; i < count; i++)
+		mm_free(blocks[i]);
+	stop_timing(t);
+	return count;
+}
+
+/*
+ * coalesce_both - Free every other block, then time freeing the rest, so
+ *     every timed free merges with free blocks on both sides: case 4 of
+ *     coalesce(), with the longest possible chain of merges
+ */
+static long
+coalesce_both(size_t size, long count, char **blocks, timing_t *t)
+{
+	long i;
+
+	fill(size, count, blocks);
+	for (i = 1; i < count; i += 2)
+		mm_free(blocks[i]);
+	start_timing(t);
+	for (i = 0; i < count; i += 2)
+		mm_free(blocks[i]);
+	stop_timing(t);
+	return (count + 1) / 2;
+}
+
+/*
+ * realloc_grow - Grow one block by size bytes at a time.  The block is
+ *     at the end of the heap, so it mostly grows into the free block
+ *     after it, and is copied when the heap has to be extended.
+ */
+static long
+realloc_grow(size_t size, long count, char **blocks, timing_t *t)
+{
+	char *p;
+	long i;
+
+	(void)blocks;
+	heap_init();
+	p = alloc(size);
+	start_timing(t);
+	for (i = 2; i <= count + 1; i++)
+		if ((p = mm_realloc(p, i * size)) == NULL)
+			app_error("mm_realloc failed");
+	stop_timing(t);
+	return count;
+}
+
+/*
+ * realloc_shrink - Shrink one large block by size bytes at a time, which
+ *     reuses the block in place and frees the part that is cut off
+ */
+static long
+realloc_shrink(size_t size, long count, char **blocks, timing_t *t)
+{
+	char *p;
+	long i;
+
+	(void)blocks;
+	heap_init();
+	p = alloc((count + 1) * size);
+	alloc(size);
+	start_timing(t);
+	for (i = count; i >= 1; i--)
+		if ((p = mm_realloc(p, i * size)) == NULL)
+			app_error("mm_realloc failed");
+	stop_timing(t);
+	return count;
+}
+
+/*
+ * extend - Allocate blocks that are too large to fit in the free space,
+ *     so every request calls extend_heap()
+ */
+static long
+extend(size_t size, long count, char **blocks, timing_t *t)
+{
+	long i;
+
+	(void)blocks;
+	heap_init();
+	start_timing(t);
+	for (i = 0; i < count; i++)
+		alloc(size);
+	stop_timing(t);
+	return count;
+}
+
+/*
+ * scan - Free every other block, then allocate and free blocks a quarter
+ *     larger, with no fit threshold, so that every request passes over
+ *     all count free blocks before it finds one that fits.  With
+ *     MM_SIDE_INDEX=1, this times find_fit's scan of a size array, and
+ *     MM_FIRST_FIT chooses the kernel that scans it.  The requests stay
+ *     in the class of the free blocks for the default size.
+ */
+static long
+scan(size_t size, long count, char **blocks, timing_t *t)
+{
+	mm_config_t saved, c;
+	long i;
+
+	mm_get_config(&saved);
+	c = saved;
+	c.fit_threshold = -1;
+	if (mm_set_config(&c) < 0)
+		app_error("mm_set_config failed");
+	fill(size, 2 * count, blocks);
+	for (i = 0; i < 2 * count; i += 2)
+		mm_free(blocks[i]);
+	mm_free(alloc(size + size / 4));
+	start_timing(t);
+	for (i = 0; i < count; i++)
+		mm_free(alloc(size + size / 4));
+	stop_timing(t);
+	mm_set_config(&saved);
+	return count;
+}
+
+/*
+ * run_kernel - Run a kernel reps times and print its fastest time per
+ *     request.  For a kernel that holds many blocks at once, the number
+ *     of requests is cut down to what fits in the simulated heap.
+ */
+static void
+run_kernel(const kernel_t *k, size_t size, long count, int reps,
+    char **blocks)
+{
+	timing_t t;
+	double best_ns = 0, best_cycles = 0;
+	long ops = 0, maxcount;
+	int r;
+
+	/*
+	 * Leave half of the heap for mm's slack and its side tables.  The
+	 * realloc kernel's footprint is its block of count * size bytes, and
+	 * a copy of it.
+	 */
+	if (k->footprint > 0) {
+		maxcount = (mem_get_max_heap() / 2) /
+		    (k->footprint * (size + BLOCK_OVHD));
+		if (count > maxcount)
+			count = maxcount;
+	}
+
+	for (r = 0; r < reps; r++) {
+		ops = k->run(size, count, blocks, &t);
+		if (r == 0 || t.ns < best_ns) {
+			best_ns = t.ns;
+			best_cycles = t.cycles;
+		}
+	}
+	printf("%-10s%8zu%10ld%10.1f%11.1f\n", k->name, size, ops,
+	    best_ns / ops, best_cycles / ops);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *kernel = NULL;
+	long count = DEFAULT_COUNT;
+	int reps = DEFAULT_REPS;
+	size_t size = 0;
+	char **blocks;
+	int c, i, found = 0;
+
+	while ((c = getopt(argc, argv, "H:k:n:r:s:h")) != EOF) {
+		switch (c) {
+		case 'H': /* Back the heap with huge pages */
+			if (!strcmp(optarg, "thp"))
+				mem_set_pages(MEM_PAGES_THP);
+			else if (!strcmp(optarg, "hugetlb"))
+				mem_set_pages(MEM_PAGES_HUGETLB);
+			else {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'k': /* Run just this kernel */
+			kernel = optarg;
+			break;
+		case 'n': /* Number of requests to time */
+			count = atol(optarg);
+			break;
+		case 'r': /* Number of repetitions */
+			reps = atoi(optarg);
+			break;
+		case 's': /* Payload size of the blocks */
+			if ((size = atol(optarg)) == 0) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'h': /* Print this message */
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (count < 1 || reps < 1) {
+		usage();
+		exit(1);
+	}
+
+	if ((blocks = malloc(2 * count * sizeof(char *))) == NULL)
+		app_error("malloc of the block array failed");
+	mem_init();
+
+	printf("%-10s%8s%10s%10s%11s\n", "kernel", "size", "ops", "ns/op",
+	    "cycles/op");
+	for (i = 0; i < NKERNELS; i++) {
+		if (kernel != NULL && strcmp(kernel, kernels[i].name))
+			continue;
+		found = 1;
+		if (size != 0)
+			run_kernel(&kernels[i], size, count, reps, blocks);
+		else if (kernels[i].run == pairs) {
+			for (size_t s = 16; s <= PAIRS_MAXSIZE; s *= 2)
+				run_kernel(&kernels[i], s, count, reps, blocks);
+		} else
+			run_kernel(&kernels[i],
+			    (kernels[i].run == extend) ? EXTEND_SIZE :
+							 DEFAULT_SIZE,
+			    count, reps, blocks);
+	}
+	if (!found) {
+		fprintf(stderr, "mbench: no kernel named %s\n", kernel);
+		usage();
+		exit(1);
+	}
+
+	free(blocks);
+	mem_deinit();
+	exit(0);
+}
+
+/*
+ * usage - Explain the command line arguments and list the kernels
+ */
+static void
+usage(void)
+{
+	int i;
+
+	fprintf(stderr,
+	    "Usage: mbench [-h] [-H <pages>] [-k <kernel>] [-n <count>] [-r <reps>]\n"
+	    "              [-s <size>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr,
+	    "\t-H <pages> Back the heap with \"thp\" or \"hugetlb\" huge pages.\n");
+	fprintf(stderr, "\t-k <name>  Run only the named kernel.\n");
+	fprintf(stderr,
+	    "\t-n <count> Time <count> requests per run (default %d).\n",
+	    DEFAULT_COUNT);
+	fprintf(stderr,
+	    "\t-r <reps>  Report the fastest of <reps> runs (default %d).\n",
+	    DEFAULT_REPS);
+	fprintf(stderr,
+	    "\t-s <size>  Use blocks of <size> bytes (default: per kernel).\n");
+	fprintf(stderr, "Kernels\n");
+	for (i = 0; i < NKERNELS; i++)
+		fprintf(stderr, "\t%-10s %s\n", kernels[i].name,
+		    kernels[i].desc);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void
+app_error(char *msg)
+{
+	fprintf(stderr, "mbench: %s\n", msg);
+	exit(1);
+}
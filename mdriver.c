@@ -7,9 +7,21 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* for sched_setaffinity() */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,10 +29,16 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "bintrace.h"
+#include "clock.h"
 #include "config.h"
+#include "engine.h"
 #include "fsecs.h"
+#include "lathist.h"
 #include "memlib.h"
 #include "mm.h"
+#include "perfctr.h"
+#include "snapshot.h"
 
 /**********************
  * Constants and macros
@@ -33,6 +51,34 @@
 	(i + 5) /* cnvt trace request nums to linenums (origin 1) \
 		 */
 
+/* Streaming replay (-s) */
+#define STREAM_CHUNK   4096 /* requests read from a streamed trace at a time */
+#define IDMAP_MINSLOTS 1024 /* initial size of a streamed trace's id map */
+
+/* Multithreaded scaling benchmark (-m) */
+#define MT_REPS 3 /* runs per thread count; the fastest one is reported */
+
+/* Fragmentation profile (-F) */
+#define FRAG_FILE    "frag.csv" /* default file for the profile */
+#define FRAG_CLASSES 16		/* power-of-two classes from 32 B to 1 MB */
+
+/* Heap snapshots (-S) */
+#define MAXSNAPS   64	/* max requests to write snapshots after */
+#define SNAP_BATCH 4096 /* records buffered before each fwrite() */
+
+/* Engines (-e) */
+#define MAXENGINES 16 /* max engines compared in one run */
+
+/* Policy auto-tuner (-T) */
+#define TUNE_KNOBS 6  /* threshold, classes, chunk, split, side, addr */
+#define MAXTUNE	   16 /* max values swept per knob */
+
+/* Machine-readable results (-o) and the baseline comparison (-b) */
+#define MAXFIELDS  64	/* max metrics written per trace */
+#define RESULTLINE 4096 /* max length of a line of a results file */
+#define REGRESS_SLOWDOWN 0.05 /* slowdown flagged without confidence intervals */
+#define REGRESS_UTIL	 0.001 /* drop in utilization that is flagged */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p) ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
@@ -47,25 +93,66 @@ typedef struct range_t {
 	struct range_t *next; /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-	enum { ALLOC, FREE, REALLOC } type; /* type of request */
-	int index;			    /* index for free() to use later */
-	int size; /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+/*
+ * Holds the information for one trace file.  The requests themselves
+ * (traceop_t) are defined in bintrace.h, because a binary trace file is
+ * mapped and replayed in place.
+ */
 typedef struct {
-	unsigned sugg_heapsize; /* suggested heap size (unused) */
-	unsigned num_ids;	/* number of alloc/realloc ids */
-	unsigned num_ops;	/* number of distinct requests */
-	unsigned weight;	/* weight for this trace (unused) */
+	uint64_t sugg_heapsize; /* suggested heap size (unused) */
+	uint64_t num_ids;	/* number of alloc/realloc ids */
+	uint64_t num_ops;	/* number of distinct requests */
+	uint64_t weight;	/* weight for this trace (unused) */
 	traceop_t *ops;		/* array of requests */
 	char **blocks; /* array of ptrs returned by malloc/realloc... */
 	size_t
 	    *block_sizes; /* ... and a corresponding array of payload sizes */
+	void *map;	  /* mapping of a binary trace file, or NULL */
+	size_t map_len;	  /* length of that mapping */
 } trace_t;
 
+/* Holds the requests that one thread of the scaling benchmark replays */
+typedef struct {
+	traceop_t *ops;		    /* this thread's requests, in trace order */
+	uint64_t num_ops;	    /* number of requests in ops */
+	char **blocks;		    /* payloads by id, possibly shared */
+	pthread_barrier_t *barrier; /* releases all threads at once */
+	double start;		    /* when this thread started (secs) */
+	double secs;		    /* time this thread took */
+	int out_of_heap;	    /* a request failed, so the thread quit */
+} mt_thread_t;
+
+/*
+ * Reads the requests of a trace that is too large to hold in memory in
+ * chunks of STREAM_CHUNK, from either a file or a pipe.
+ */
+typedef struct {
+	FILE *fp;			/* the trace file or pipe */
+	int binary;			/* is this a binary (bintrace.h) trace? */
+	int seekable;			/* can it be rewound for another pass? */
+	off_t data_off;			/* offset of the first request */
+	traceop_t chunk[STREAM_CHUNK];	/* the requests read most recently */
+} stream_t;
+
+/* Records one live block of a streamed trace */
+typedef struct {
+	uint64_t id; /* the trace's id for the block */
+	char *p;     /* payload address, or NULL if the slot is empty */
+	size_t size; /* payload size */
+} idslot_t;
+
+/*
+ * Maps the ids of a streamed trace to their blocks.  Unlike the blocks
+ * array of a trace_t, which is indexed by every id in the trace, the map
+ * only holds the blocks that are live, so its size is bounded by the
+ * peak live set rather than by the length of the trace.
+ */
+typedef struct {
+	idslot_t *slots; /* open addressing table with linear probing */
+	size_t mask;	 /* number of slots - 1 */
+	size_t count;	 /* number of live blocks */
+} idmap_t;
+
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -86,9 +173,64 @@ typedef struct {
 	/* defined only for the student malloc package */
 	double util; /* space utilization for this trace (always 0 for libc) */
 
+	/* the heap at the end of the checks: its size, the bytes committed
+	 * to it, the bytes of those that the trace touched (resident), and
+	 * the bytes backed by huge pages (-H) */
+	double heap, committed, resident, huge;
+
+	/* hardware events per timed run (-P), or -1 if not counted */
+	double events[PERFCTR_NEVENTS];
+
+	/* the statistics of the benchmark runner (-B), if it timed the trace */
+	bench_t bench;
+
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* One sample of the heap for the fragmentation profile (-F) */
+typedef struct {
+	size_t alloc;		       /* bytes in allocated blocks */
+	size_t free;		       /* bytes in free blocks */
+	size_t largest;		       /* largest free block */
+	size_t by_class[FRAG_CLASSES]; /* free bytes by power-of-two class */
+} frag_t;
+
+/* The state of a heap snapshot that is being written (-S) */
+typedef struct {
+	FILE *fp;			  /* the snapshot file */
+	char *heap_lo;			  /* the first block, or NULL */
+	char *heap_end;			  /* the end of the last block */
+	char *region_end;		  /* the end of the last block's region */
+	uint64_t seg_bytes;		  /* bytes of the regions with blocks */
+	uint64_t nblocks;		  /* records written so far */
+	int nbatch;			  /* records in batch */
+	snapshot_rec_t batch[SNAP_BATCH]; /* records not yet written */
+} snapwriter_t;
+
+/* The metrics of one trace in a baseline results file (-b) */
+typedef struct {
+	char name[MAXLINE]; /* trace file name */
+	int valid;	    /* was the trace valid? */
+	double util;	    /* space utilization */
+	double secs;	    /* time per replay */
+	double lo, hi;	    /* 95% CI of secs (-B), or NAN */
+} baseline_t;
+
+/* The results of one policy of the auto-tuner (-T) over all traces */
+typedef struct {
+	mm_config_t config; /* the policy */
+	int valid;	    /* were all of the traces valid? */
+	double util;	    /* average space utilization */
+	double thru;	    /* throughput (ops/sec) */
+	int front;	    /* is it on the throughput/util Pareto front? */
+} tune_t;
+
+/* What a worker process (-j) reports back about its trace */
+typedef struct {
+	int errors;    /* number of errors the worker found */
+	stats_t stats; /* everything but secs, which the parent measures */
+} job_result_t;
+
 /********************
  * Global variables
  *******************/
@@ -96,37 +238,151 @@ int verbose = 0;       /* global flag for verbose output */
 static int errors = 0; /* number of errs found when running student malloc */
 char msg[MAXLINE];     /* for whenever we need to compose an error message */
 
+/* The malloc package that the evaluations replay the traces through */
+static const engine_t *engine = &mm_engine;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = { DEFAULT_TRACEFILES, NULL };
 
+/* Per-trace latency histograms, indexed by request type (-p), or NULL */
+static lathist_t (*lat_hists)[3] = NULL;
+
+/* Hardware counters run around the timed replays (-P) */
+static int use_counters = 0;
+static perfctr_t counters;
+
+/* If set, time the traces with the benchmark runner (-B) */
+static int use_bench = 0;
+
+/* The libc malloc package's results for each trace (-l), or NULL */
+static stats_t *libc_stats = NULL;
+
+/* Write heap snapshots after these requests, sorted, and at the peak (-S) */
+static uint64_t snap_ops[MAXSNAPS];
+static int num_snaps = 0;
+static int snap_peak = 0;
+
+/* Run mm_checkheap every check_every requests of the checks (-c) */
+static uint64_t check_every = 0;
+
+/* The values of each policy knob that the auto-tuner sweeps (-T) */
+static const char *tune_names[TUNE_KNOBS] = { "threshold", "classes",
+	"chunk", "split", "side", "addr" };
+static long tune_vals[TUNE_KNOBS][MAXTUNE];
+static int tune_nvals[TUNE_KNOBS];
+static int tuning = 0;
+
+/* Sample the heap every frag_every requests of eval_mm_util (-F) */
+static uint64_t frag_every = 0;
+static FILE *frag_fp = NULL;
+
 /*********************
  * Function prototypes
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, int tracenum,
+static int add_range(range_t **ranges, char *lo, size_t size, int tracenum,
     int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static int map_trace(trace_t *trace, char *path);
 static void free_trace(trace_t *trace);
 
+/* These functions read traces in chunks and map their ids to blocks */
+static stream_t *open_stream(char *tracedir, char *filename);
+static int rewind_stream(stream_t *s);
+static size_t read_stream(stream_t *s);
+static void close_stream(stream_t *s);
+static void idmap_init(idmap_t *map);
+static idslot_t *idmap_find(idmap_t *map, uint64_t id);
+static idslot_t *idmap_insert(idmap_t *map, uint64_t id);
+static void idmap_remove(idmap_t *map, idslot_t *slot);
+static void idmap_free(idmap_t *map);
+
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
+static int check_heap(int tracenum, uint64_t opnum);
+static void record_memory(stats_t *stats);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void time_speed(fsecs_test_funct f, speed_t *speed_params,
+    stats_t *stats);
+
+/* Routines for timing the libc malloc package on the same traces */
+static void eval_libc_speed(void *ptr);
+static void eval_libc(const engine_t *e, trace_t *trace, stats_t *stats);
+static void eval_mm_latency(trace_t *trace, lathist_t *hists);
+static void frag_visit(void *bp, size_t size, int alloc, int cls,
+    void *arg);
+static void sample_frag(int tracenum, uint64_t opnum, size_t live);
+static void eval_mm_snapshots(trace_t *trace, int tracenum);
+static void replay_op(trace_t *trace, uint64_t i, size_t *live);
+static void snap_visit(void *bp, size_t size, int alloc, int cls,
+    void *arg);
+static void write_snapshot(int tracenum, uint64_t opnum, size_t live);
+
+/* The same evaluations, for traces that are streamed rather than read */
+static int eval_mm_valid_stream(stream_t *s, int tracenum, stats_t *stats);
+static double eval_mm_speed_stream(stream_t *s);
+static void eval_mm_stream(char *tracedir, char *filename, int tracenum,
+    stats_t *stats);
+
+/* Measure how the mm malloc package scales across threads */
+static void eval_mm_scaling(char **tracefiles, int num_tracefiles,
+    int shard, stats_t *stats);
+static double run_mm_threads(mt_thread_t *threads, int nthreads,
+    uint64_t num_ops);
+static void *mt_replay(void *arg);
+static void print_scaling(mt_thread_t *threads, int nthreads, double rate,
+    double base);
+
+/* Evaluate several traces at once, in worker processes */
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles, int jobs,
+    int stream, stats_t *stats);
+static void eval_mm_checks(char *filename, int tracenum, int stream,
+    stats_t *stats);
+static void eval_mm_timing(char *filename, int tracenum, int stream,
+    stats_t *stats);
+
+/* Compare several malloc packages side by side (-e) */
+static void eval_engines(char **tracefiles, int num_tracefiles,
+    const engine_t **sel, int nsel);
+static void printengines(int num_tracefiles, const engine_t **sel, int nsel,
+    stats_t *stats);
+
+/* Sweep the mm package's policy knobs (-T) */
+static void eval_mm_tune(char **tracefiles, int num_tracefiles);
+static void set_knob(mm_config_t *config, int knob, long val);
+static int cmp_tune(const void *a, const void *b);
 
 /* Various helper routines */
-static void printresults(int n, stats_t *stats);
+static void printresults(int n, stats_t *stats, int checked);
+static void printutil(int checked, double util);
+static void printevents(const double *events, double ops);
+static void printmemory(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printbench(int n, stats_t *stats);
+static void printlibc(int n, stats_t *stats);
+static void parse_snapshots(char *list);
+static void parse_tune(char *arg);
+static size_t parse_size(const char *arg);
+static int parse_engines(char *list, const engine_t **sel);
+static int trace_fields(stats_t *stats, int tracenum, char names[][32],
+    double *values);
+static void writeresults(char *path, char **tracefiles, int n,
+    stats_t *stats);
+static int compare_baseline(char *path, char **tracefiles, int n,
+    stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
+static void malloc_error(int tracenum, uint64_t opnum, char *msg);
 static void app_error(char *msg);
 
 /**************
@@ -147,6 +403,23 @@ main(int argc, char **argv)
 
 	int team_check = 1; /* If set, check team structure (reset by -a) */
 	int autograder = 0; /* If set, emit summary info for autograder (-g) */
+	int stream = 0;	    /* If set, stream traces instead of reading them */
+	int jobs = 1;	    /* Number of traces to check at once (-j) */
+	char *scaling = NULL; /* Multithreaded benchmark mode (-m) */
+	int latency = 0;      /* If set, record per-request latencies (-p) */
+	char *outfile = NULL; /* Write the results to this file (-o) */
+	char *fragfile = FRAG_FILE; /* Write the fragmentation profile here */
+	char *end;
+	char *basefile = NULL; /* Compare the results with this file (-b) */
+	int regressions = 0;   /* Traces that regressed from the baseline */
+	int libc = 0;	      /* If set, also time libc malloc (-l, -L) */
+	int libc_norm = 0;    /* If set, normalize by libc's throughput (-L) */
+	double libc_throughput = AVG_LIBC_THRUPUT; /* the throughput cap */
+	double libc_secs, libc_ops;
+	size_t max_heap; /* the largest the heap may grow (-M) */
+	const engine_t *sel[MAXENGINES]; /* the engines given with -e */
+	int nsel = 0;
+	int compare = 0; /* If set, compare the engines side by side */
 
 	/* temporaries used to compute the performance index */
 	double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2,
@@ -156,7 +429,7 @@ main(int argc, char **argv)
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "gf:t:avVh")) != EOF) {
+	while ((c = getopt(argc, argv, "gf:t:c:e:j:m:o:b:lLM:pPsB:F:H:S:T:avVh")) != EOF) {
 		switch (c) {
 		case 'g': /* Generate summary info for the autograder */
 			autograder = 1;
@@ -180,6 +453,91 @@ main(int argc, char **argv)
 				strcat(tracedir,
 				    "/"); /* path always ends with "/" */
 			break;
+		case 'c': /* Check the heap every <k> requests */
+			check_every = strtoull(optarg, &end, 10);
+			if (check_every == 0 || *end != '\0') {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'e': /* Replay the traces through these engines */
+			nsel = parse_engines(optarg, sel);
+			break;
+		case 'M': /* Let the heap grow to this size */
+			if ((max_heap = parse_size(optarg)) == 0) {
+				usage();
+				exit(1);
+			}
+			mem_set_max_heap(max_heap);
+			break;
+		case 'H': /* Back the heap with huge pages */
+			if (!strcmp(optarg, "thp"))
+				mem_set_pages(MEM_PAGES_THP);
+			else if (!strcmp(optarg, "hugetlb"))
+				mem_set_pages(MEM_PAGES_HUGETLB);
+			else {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'j': /* Check this many traces at once */
+			if ((jobs = atoi(optarg)) < 1) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'm': /* Measure scaling across threads */
+			if (strcmp(optarg, "shard") && strcmp(optarg, "trace")) {
+				usage();
+				exit(1);
+			}
+			scaling = optarg;
+			break;
+		case 'o': /* Write the results as CSV or JSON */
+			outfile = optarg;
+			break;
+		case 'b': /* Compare the results with a baseline */
+			basefile = optarg;
+			break;
+		case 'l': /* Also time libc malloc on the traces */
+			libc = 1;
+			break;
+		case 'L': /* ... and cap the throughput score at its rate */
+			libc = 1;
+			libc_norm = 1;
+			break;
+		case 'F': /* Profile fragmentation every <n> requests */
+			frag_every = strtoull(optarg, &end, 10);
+			if (frag_every == 0 || (*end != '\0' && *end != ':')) {
+				usage();
+				exit(1);
+			}
+			if (*end == ':')
+				fragfile = end + 1;
+			break;
+		case 'S': /* Write heap snapshots */
+			parse_snapshots(optarg);
+			break;
+		case 'T': /* Sweep a policy knob of the mm package */
+			parse_tune(optarg);
+			break;
+		case 'p': /* Record latency percentiles */
+			latency = 1;
+			break;
+		case 'P': /* Count hardware events during the timed runs */
+			use_counters = 1;
+			break;
+		case 'B': /* Benchmark to a target confidence interval */
+			if (atof(optarg) <= 0) {
+				usage();
+				exit(1);
+			}
+			set_bench_target(atof(optarg) / 100);
+			use_bench = 1;
+			break;
+		case 's': /* Stream traces too large to hold in memory */
+			stream = 1;
+			break;
 		case 'a': /* Don't check team structure */
 			team_check = 0;
 			break;
@@ -236,9 +594,53 @@ main(int argc, char **argv)
 		printf("Using default tracefiles in %s\n", tracedir);
 	}
 
+	/*
+	 * One engine (-e) stands in for mm.  Several, or one that is only
+	 * timed, are compared side by side instead of being scored.
+	 */
+	if (nsel == 1 && sel[0]->checked)
+		engine = sel[0];
+	else if (nsel > 0)
+		compare = 1;
+	if (tuning && (compare || engine != &mm_engine)) {
+		printf("Only mm has policy knobs; ignoring -e\n");
+		engine = &mm_engine;
+		compare = 0;
+	}
+	if (compare && (stream || latency || libc || frag_every ||
+			   num_snaps > 0 || snap_peak || scaling || outfile ||
+			   basefile)) {
+		printf("Engines are compared without -b, -F, -l, -L, -m, -o, "
+		       "-p, -s and -S\n");
+		stream = latency = libc = libc_norm = 0;
+		frag_every = 0;
+		num_snaps = snap_peak = 0;
+		scaling = outfile = basefile = NULL;
+	}
+
+	/* The heap profiles and checks need an engine that can inspect its heap */
+	if ((frag_every || num_snaps > 0 || snap_peak) &&
+	    engine->heapwalk == NULL) {
+		printf("%s cannot walk its heap; ignoring -F and -S\n",
+		    engine->name);
+		frag_every = 0;
+		num_snaps = snap_peak = 0;
+	}
+	if (check_every && !compare && engine->checkheap == NULL) {
+		printf("%s has no heap checker; ignoring -c\n", engine->name);
+		check_every = 0;
+	}
+
 	/* Initialize the timing package */
 	init_fsecs();
 
+	/* Open the hardware counters for the timed runs */
+	if (use_counters && perfctr_open(&counters) == 0) {
+		printf("Hardware counters are unavailable; ignoring -P\n");
+		use_counters = 0;
+	} else if (use_counters)
+		fsecs_counters(&counters);
+
 	/*
 	 * Always run and evaluate the student's mm package
 	 */
@@ -250,36 +652,157 @@ main(int argc, char **argv)
 	if (mm_stats == NULL)
 		unix_error("mm_stats calloc in main failed");
 
+	/* ... and, with -p, a set of latency histograms per tracefile */
+	if (latency && stream) {
+		printf("Latencies are not recorded for streamed traces\n");
+	} else if (latency) {
+		lat_hists = calloc(num_tracefiles, sizeof(*lat_hists));
+		if (lat_hists == NULL)
+			unix_error("lat_hists calloc in main failed");
+	}
+
+	/* ... and, with -l, a stats_t struct per tracefile for libc malloc */
+	if (libc && stream) {
+		printf("Streamed traces are not replayed through libc malloc\n");
+		libc = libc_norm = 0;
+	} else if (libc) {
+		libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+		if (libc_stats == NULL)
+			unix_error("libc_stats calloc in main failed");
+	}
+
+	/* The fragmentation profile is written by one process, in order */
+	if (frag_every && stream) {
+		printf("Fragmentation is not profiled for streamed traces\n");
+		frag_every = 0;
+	} else if (frag_every) {
+		if (jobs > 1) {
+			printf("Fragmentation is profiled serially; ignoring -j\n");
+			jobs = 1;
+		}
+		if ((frag_fp = fopen(fragfile, "w")) == NULL)
+			unix_error("Could not open the fragmentation profile");
+		fprintf(frag_fp, "trace,op,heap,live,alloc,free,largest_free");
+		for (i = 0; i < FRAG_CLASSES; i++)
+			fprintf(frag_fp, ",free_%d", 32 << i);
+		fprintf(frag_fp, "\n");
+	}
+
+	/* Heap snapshots need a trace that can be replayed again */
+	if ((num_snaps > 0 || snap_peak) && stream) {
+		printf("Heap snapshots are not written for streamed traces\n");
+		num_snaps = snap_peak = 0;
+	}
+
+	/* The benchmark runner needs a trace that it can replay at will */
+	if (use_bench && stream) {
+		printf("Streamed traces are timed without the benchmark runner\n");
+		use_bench = 0;
+	}
+
+	/* The auto-tuner replays each trace many times */
+	if (tuning && stream) {
+		printf("Policies are tuned on traces read into memory; "
+		       "ignoring -s\n");
+		stream = 0;
+	}
+
 	/* Initialize the simulated memory system in memlib.c */
 	mem_init();
 
+	/* With -T, sweep the policy knobs instead of scoring one policy */
+	if (tuning) {
+		eval_mm_tune(tracefiles, num_tracefiles);
+		exit(0);
+	}
+
+	/* With several engines, compare them instead of scoring one */
+	if (compare) {
+		eval_engines(tracefiles, num_tracefiles, sel, nsel);
+		exit(0);
+	}
+
 	/* Evaluate student's mm malloc package using the K-best scheme */
-	for (i = 0; i < num_tracefiles; i++) {
+	if (jobs > 1)
+		eval_mm_parallel(tracefiles, num_tracefiles, jobs, stream,
+		    mm_stats);
+	for (i = 0; jobs <= 1 && i < num_tracefiles; i++) {
+		if (stream) {
+			eval_mm_stream(tracedir, tracefiles[i], i, &mm_stats[i]);
+			continue;
+		}
 		trace = read_trace(tracedir, tracefiles[i]);
 		mm_stats[i].ops = trace->num_ops;
 		if (verbose > 1)
 			printf("Checking mm_malloc for correctness, ");
 		mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+		record_memory(&mm_stats[i]);
 		if (mm_stats[i].valid) {
 			if (verbose > 1)
 				printf("efficiency, ");
 			mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+			if (num_snaps > 0 || snap_peak)
+				eval_mm_snapshots(trace, i);
 			speed_params.trace = trace;
 			speed_params.ranges = ranges;
 			if (verbose > 1)
 				printf("and performance.\n");
-			mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+			time_speed(eval_mm_speed, &speed_params, &mm_stats[i]);
+			if (lat_hists != NULL)
+				eval_mm_latency(trace, lat_hists[i]);
+			if (libc_stats != NULL)
+				eval_libc(&libc_engine, trace, &libc_stats[i]);
 		}
 		free_trace(trace);
 	}
 
+	if (frag_fp != NULL && fclose(frag_fp) != 0)
+		unix_error("Could not write the fragmentation profile");
+
 	/* Display the mm results in a compact table */
-	if (verbose) {
+	if (verbose || use_counters) {
 		printf("\nResults for mm malloc:\n");
-		printresults(num_tracefiles, mm_stats);
+		printresults(num_tracefiles, mm_stats, 1);
+		printf("\n");
+	}
+
+	/* ... and how much memory each trace really used */
+	if (verbose) {
+		printmemory(num_tracefiles, mm_stats);
 		printf("\n");
 	}
 
+	/* Display the libc results, and how mm malloc compares */
+	if (libc_stats != NULL) {
+		if (verbose) {
+			printf("Results for libc malloc:\n");
+			printresults(num_tracefiles, libc_stats,
+			    libc_engine.checked);
+			printf("\n");
+		}
+		printlibc(num_tracefiles, mm_stats);
+	}
+
+	/* Display the latency percentiles, if they were recorded */
+	if (lat_hists != NULL)
+		printlatency(num_tracefiles, mm_stats);
+
+	/* Display the precision of the benchmark runner's timings */
+	if (use_bench)
+		printbench(num_tracefiles, mm_stats);
+
+	/* Save the results, and check them against the baseline */
+	if (outfile != NULL)
+		writeresults(outfile, tracefiles, num_tracefiles, mm_stats);
+	if (basefile != NULL)
+		regressions = compare_baseline(basefile, tracefiles,
+		    num_tracefiles, mm_stats);
+
+	/* Measure how the valid traces scale across threads */
+	if (scaling)
+		eval_mm_scaling(tracefiles, num_tracefiles,
+		    !strcmp(scaling, "shard"), mm_stats);
+
 	/*
 	 * Accumulate the aggregate statistics for the student's mm package
 	 */
@@ -289,32 +812,57 @@ main(int argc, char **argv)
 	numcorrect = 0;
 	for (i = 0; i < num_tracefiles; i++) {
 		secs += mm_stats[i].secs;
-		ops += mm_stats[i].ops;
+		if (mm_stats[i].secs > 0) /* not a piped trace (-s) */
+			ops += mm_stats[i].ops;
 		util += mm_stats[i].util;
 		if (mm_stats[i].valid)
 			numcorrect++;
 	}
 	avg_mm_util = util / num_tracefiles;
 
+	/* With -L, the cap is libc's throughput on the same traces */
+	if (libc_norm) {
+		libc_secs = 0;
+		libc_ops = 0;
+		for (i = 0; i < num_tracefiles; i++) {
+			libc_secs += libc_stats[i].secs;
+			if (libc_stats[i].secs > 0)
+				libc_ops += libc_stats[i].ops;
+		}
+		if (libc_secs > 0) {
+			libc_throughput = libc_ops / libc_secs;
+			printf("Throughput is normalized by libc's %.0f Kops\n",
+			    libc_throughput / 1e3);
+		}
+	}
+
 	/*
 	 * Compute and print the performance index
 	 */
 	if (errors == 0) {
-		avg_mm_throughput = ops / secs;
+		avg_mm_throughput = (secs > 0) ? ops / secs : 0;
 
 		p1 = UTIL_WEIGHT * avg_mm_util;
-		if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+		if (avg_mm_throughput > libc_throughput) {
 			p2 = (double)(1.0 - UTIL_WEIGHT);
 		} else {
 			p2 = ((double)(1.0 - UTIL_WEIGHT)) *
-			    (avg_mm_throughput / AVG_LIBC_THRUPUT);
+			    (avg_mm_throughput / libc_throughput);
 		}
 
-		perfindex = (p1 + p2) * 100.0;
-		printf(
-		    "Perf index = %.0f/%.0f (util) + %.0f/%.0f (thru) = %.0f/100\n",
-		    p1 * 100, UTIL_WEIGHT * 100, p2 * 100,
-		    (1.0 - UTIL_WEIGHT) * 100, perfindex);
+		/* A piped trace (-s) is not timed, so it has no throughput */
+		if (secs == 0) {
+			perfindex = p1 * 100.0;
+			printf("Perf index = %.0f/%.0f (util); throughput not "
+			       "measured, since no trace was timed\n",
+			    p1 * 100, UTIL_WEIGHT * 100);
+		} else {
+			perfindex = (p1 + p2) * 100.0;
+			printf("Perf index = %.0f/%.0f (util) + %.0f/%.0f (thru) "
+			       "= %.0f/100\n",
+			    p1 * 100, UTIL_WEIGHT * 100, p2 * 100,
+			    (1.0 - UTIL_WEIGHT) * 100, perfindex);
+		}
 
 	} else { /* There were errors */
 		perfindex = 0.0;
@@ -326,7 +874,7 @@ main(int argc, char **argv)
 		printf("perfidx:%.0f\n", perfindex);
 	}
 
-	exit(0);
+	exit(regressions > 0);
 }
 
 /*****************************************************************
@@ -342,7 +890,7 @@ main(int argc, char **argv)
  *     we create a range struct for this block and add it to the range list.
  */
 static int
-add_range(range_t **ranges, char *lo, int size, int tracenum, int opnum)
+add_range(range_t **ranges, char *lo, size_t size, int tracenum, int opnum)
 {
 	char *hi = lo + size - 1;
 	range_t *p;
@@ -436,7 +984,8 @@ clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory.  Binary traces
+ *     (see bintrace.h) are mapped rather than read.
  */
 static trace_t *
 read_trace(char *tracedir, char *filename)
@@ -445,9 +994,9 @@ read_trace(char *tracedir, char *filename)
 	trace_t *trace;
 	char type[MAXLINE];
 	char path[896]; // XXX alc: This can't be MAXLINE.
-	unsigned index, size;
-	unsigned max_index = 0;
-	unsigned op_index;
+	unsigned long long index, size;
+	unsigned long long max_index = 0;
+	uint64_t op_index;
 
 	if (verbose > 1)
 		printf("Reading tracefile: %s\n", filename);
@@ -459,19 +1008,25 @@ read_trace(char *tracedir, char *filename)
 	/* Read the trace file header */
 	strcpy(path, tracedir);
 	strcat(path, filename);
-	if ((tracefile = fopen(path, "r")) == NULL) {
-		sprintf(msg, "Could not open %s in read_trace", path);
-		unix_error(msg);
+	trace->map = NULL;
+	trace->map_len = 0;
+	tracefile = NULL;
+	if (!map_trace(trace, path)) {
+		if ((tracefile = fopen(path, "r")) == NULL) {
+			sprintf(msg, "Could not open %s in read_trace", path);
+			unix_error(msg);
+		}
+		fscanf(tracefile, "%" SCNu64,
+		    &(trace->sugg_heapsize)); /* not used */
+		fscanf(tracefile, "%" SCNu64, &(trace->num_ids));
+		fscanf(tracefile, "%" SCNu64, &(trace->num_ops));
+		fscanf(tracefile, "%" SCNu64, &(trace->weight)); /* not used */
+
+		/* We'll store each request line in the trace in this array */
+		if ((trace->ops = (traceop_t *)malloc(
+			 trace->num_ops * sizeof(traceop_t))) == NULL)
+			unix_error("malloc 2 failed in read_trace");
 	}
-	fscanf(tracefile, "%u", &(trace->sugg_heapsize)); /* not used */
-	fscanf(tracefile, "%u", &(trace->num_ids));
-	fscanf(tracefile, "%u", &(trace->num_ops));
-	fscanf(tracefile, "%u", &(trace->weight)); /* not used */
-
-	/* We'll store each request line in the trace in this array */
-	if ((trace->ops = (traceop_t *)malloc(
-		 trace->num_ops * sizeof(traceop_t))) == NULL)
-		unix_error("malloc 2 failed in read_trace");
 
 	/* We'll keep an array of pointers to the allocated blocks here... */
 	if ((trace->blocks = (char **)malloc(
@@ -483,27 +1038,31 @@ read_trace(char *tracedir, char *filename)
 		 trace->num_ids * sizeof(size_t))) == NULL)
 		unix_error("malloc 4 failed in read_trace");
 
+	/* A mapped trace is replayed in place; there is nothing to parse. */
+	if (tracefile == NULL)
+		return trace;
+
 	/* read every request line in the trace file */
 	index = 0;
 	op_index = 0;
 	while (fscanf(tracefile, "%s", type) != EOF) {
 		switch (type[0]) {
 		case 'a':
-			fscanf(tracefile, "%u %u", &index, &size);
+			fscanf(tracefile, "%llu %llu", &index, &size);
 			trace->ops[op_index].type = ALLOC;
 			trace->ops[op_index].index = index;
 			trace->ops[op_index].size = size;
 			max_index = (index > max_index) ? index : max_index;
 			break;
 		case 'r':
-			fscanf(tracefile, "%u %u", &index, &size);
+			fscanf(tracefile, "%llu %llu", &index, &size);
 			trace->ops[op_index].type = REALLOC;
 			trace->ops[op_index].index = index;
 			trace->ops[op_index].size = size;
 			max_index = (index > max_index) ? index : max_index;
 			break;
 		case 'f':
-			fscanf(tracefile, "%ud", &index);
+			fscanf(tracefile, "%llu", &index);
 			trace->ops[op_index].type = FREE;
 			trace->ops[op_index].index = index;
 			break;
@@ -521,19 +1080,383 @@ read_trace(char *tracedir, char *filename)
 	return trace;
 }
 
+/*
+ * map_trace - If the file at path is a binary trace, map it read-only
+ *     and point trace->ops at the records inside the mapping.  Returns 1
+ *     if the trace was mapped and 0 if the file is a text trace.
+ */
+static int
+map_trace(trace_t *trace, char *path)
+{
+	bintrace_hdr_t hdr;
+	struct stat st;
+	traceop_t *ops;
+	uint64_t i;
+	char *map;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		sprintf(msg, "Could not open %s in map_trace", path);
+		unix_error(msg);
+	}
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    memcmp(hdr.magic, BINTRACE_MAGIC, sizeof(hdr.magic)) != 0) {
+		close(fd);
+		return 0;
+	}
+	if (hdr.version != BINTRACE_VERSION ||
+	    hdr.op_size != sizeof(traceop_t)) {
+		printf("Binary trace %s was written by an incompatible "
+		       "rep2bin\n",
+		    path);
+		exit(1);
+	}
+	if (fstat(fd, &st) < 0)
+		unix_error("fstat failed in map_trace");
+	/* The read above guarantees st_size >= sizeof(hdr). */
+	if (hdr.num_ops >
+	    ((uint64_t)st.st_size - sizeof(hdr)) / sizeof(traceop_t)) {
+		printf("Binary trace %s is truncated\n", path);
+		exit(1);
+	}
+	if ((uint64_t)st.st_size !=
+	    sizeof(hdr) + hdr.num_ops * sizeof(traceop_t)) {
+		printf("Binary trace %s has trailing bytes\n", path);
+		exit(1);
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		unix_error("mmap failed in map_trace");
+
+	/* Every replay walks the records from first to last. */
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	/*
+	 * The replay indexes the block arrays with the records as they
+	 * are, so check them once here as read_trace checks a text trace.
+	 */
+	ops = (traceop_t *)(map + sizeof(hdr));
+	for (i = 0; i < hdr.num_ops; i++) {
+		if (ops[i].type > REALLOC) {
+			printf("Bogus type (%u) in record %" PRIu64
+			       " of tracefile %s\n",
+			    (unsigned)ops[i].type, i, path);
+			exit(1);
+		}
+		if (ops[i].index >= hdr.num_ids) {
+			printf("Bogus index (%" PRIu64 ") in record %" PRIu64
+			       " of tracefile %s\n",
+			    (uint64_t)ops[i].index, i, path);
+			exit(1);
+		}
+	}
+
+	trace->sugg_heapsize = hdr.sugg_heapsize;
+	trace->num_ids = hdr.num_ids;
+	trace->num_ops = hdr.num_ops;
+	trace->weight = hdr.weight;
+	trace->ops = ops;
+	trace->map = map;
+	trace->map_len = st.st_size;
+	return 1;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace().  The ops
+ *              of a binary trace are unmapped instead.
  */
 void
 free_trace(trace_t *trace)
 {
-	free(trace->ops); /* free the three arrays... */
+	if (trace->map != NULL) /* free the three arrays... */
+		munmap(trace->map, trace->map_len);
+	else
+		free(trace->ops);
 	free(trace->blocks);
 	free(trace->block_sizes);
 	free(trace); /* and the trace record itself... */
 }
 
+/*****************************************************************
+ * The following routines stream a trace in fixed-size chunks and
+ * keep track of its live blocks, so that traces with more requests
+ * than fit in memory can be replayed with the -s option.
+ ****************************************************************/
+
+/*
+ * open_stream - Open a text or binary trace for streaming.  The file
+ *     name "-" denotes the standard input, so that a trace can be piped
+ *     in from a decompressor.
+ */
+static stream_t *
+open_stream(char *tracedir, char *filename)
+{
+	stream_t *s;
+	struct stat st;
+	char path[896]; // XXX alc: This can't be MAXLINE.
+	uint64_t hdr[4];
+	bintrace_hdr_t bhdr;
+	int c;
+
+	if (verbose > 1)
+		printf("Streaming tracefile: %s\n", filename);
+
+	if ((s = (stream_t *)malloc(sizeof(stream_t))) == NULL)
+		unix_error("malloc failed in open_stream");
+	if (strcmp(filename, "-") == 0) {
+		strcpy(path, "<stdin>");
+		s->fp = stdin;
+	} else {
+		strcpy(path, tracedir);
+		strcat(path, filename);
+		if ((s->fp = fopen(path, "r")) == NULL) {
+			sprintf(msg, "Could not open %s in open_stream", path);
+			unix_error(msg);
+		}
+	}
+	s->seekable = fstat(fileno(s->fp), &st) == 0 && S_ISREG(st.st_mode);
+
+	/* Peek at the first byte to tell a binary trace from a text one. */
+	if ((c = getc(s->fp)) == EOF) {
+		printf("Trace %s is empty\n", path);
+		exit(1);
+	}
+	ungetc(c, s->fp);
+	s->binary = (c == BINTRACE_MAGIC[0]);
+	if (s->binary) {
+		if (fread(&bhdr, sizeof(bhdr), 1, s->fp) != 1 ||
+		    memcmp(bhdr.magic, BINTRACE_MAGIC, sizeof(bhdr.magic)) !=
+			0 ||
+		    bhdr.version != BINTRACE_VERSION ||
+		    bhdr.op_size != sizeof(traceop_t)) {
+			printf("Trace %s has a bad binary header\n", path);
+			exit(1);
+		}
+	} else if (fscanf(s->fp,
+		       "%" SCNu64 "%" SCNu64 "%" SCNu64 "%" SCNu64,
+		       &hdr[0], &hdr[1], &hdr[2], &hdr[3]) != 4) {
+		printf("Trace %s has a bad header\n", path);
+		exit(1);
+	}
+	s->data_off = s->seekable ? ftello(s->fp) : 0;
+	return s;
+}
+
+/*
+ * rewind_stream - Position a stream at its first request again.
+ *     Returns 0 on success and -1 if the stream is a pipe.
+ */
+static int
+rewind_stream(stream_t *s)
+{
+	if (!s->seekable)
+		return -1;
+	if (fseeko(s->fp, s->data_off, SEEK_SET) < 0)
+		unix_error("fseeko failed in rewind_stream");
+	return 0;
+}
+
+/*
+ * read_number - Read an unsigned decimal number from a text trace,
+ *     skipping any leading white space.  Returns -1 at end of file.
+ */
+static int
+read_number(FILE *fp, uint64_t *nump)
+{
+	uint64_t num = 0;
+	int c;
+
+	while ((c = getc_unlocked(fp)) == ' ' || c == '\t' || c == '\n' ||
+	    c == '\r')
+		;
+	if (c < '0' || c > '9')
+		return -1;
+	do
+		num = num * 10 + (c - '0');
+	while ((c = getc_unlocked(fp)) >= '0' && c <= '9');
+	*nump = num;
+	return 0;
+}
+
+/*
+ * read_stream - Read the next chunk of requests into s->chunk.  Returns
+ *     the number of requests read, which is 0 at the end of the trace.
+ */
+static size_t
+read_stream(stream_t *s)
+{
+	traceop_t *op;
+	uint64_t index, size;
+	size_t n;
+	int c;
+
+	if (s->binary) {
+		n = fread(s->chunk, sizeof(traceop_t), STREAM_CHUNK, s->fp);
+		if (n < STREAM_CHUNK && ferror(s->fp))
+			unix_error("fread failed in read_stream");
+		return n;
+	}
+
+	for (n = 0; n < STREAM_CHUNK; n++) {
+		while ((c = getc_unlocked(s->fp)) == ' ' || c == '\t' ||
+		    c == '\n' || c == '\r')
+			;
+		if (c == EOF)
+			break;
+		op = &s->chunk[n];
+		switch (c) {
+		case 'a':
+		case 'r':
+			if (read_number(s->fp, &index) < 0 ||
+			    read_number(s->fp, &size) < 0)
+				app_error("Truncated request in streamed trace");
+			op->type = (c == 'a') ? ALLOC : REALLOC;
+			op->index = index;
+			op->size = size;
+			break;
+		case 'f':
+			if (read_number(s->fp, &index) < 0)
+				app_error("Truncated request in streamed trace");
+			op->type = FREE;
+			op->index = index;
+			op->size = 0;
+			break;
+		default:
+			printf("Bogus type character (%c) in streamed trace\n",
+			    c);
+			exit(1);
+		}
+	}
+	return n;
+}
+
+/*
+ * close_stream - Close a stream and free its record
+ */
+static void
+close_stream(stream_t *s)
+{
+	if (s->fp != stdin)
+		fclose(s->fp);
+	free(s);
+}
+
+/*
+ * idmap_hash - Return the home slot of an id (Fibonacci hashing)
+ */
+static inline size_t
+idmap_hash(idmap_t *map, uint64_t id)
+{
+	uint64_t h = id * 0x9E3779B97F4A7C15ULL;
+
+	return (size_t)(h ^ (h >> 32)) & map->mask;
+}
+
+/*
+ * idmap_init - Create an empty id map
+ */
+static void
+idmap_init(idmap_t *map)
+{
+	if ((map->slots = (idslot_t *)calloc(IDMAP_MINSLOTS,
+		 sizeof(idslot_t))) == NULL)
+		unix_error("calloc failed in idmap_init");
+	map->mask = IDMAP_MINSLOTS - 1;
+	map->count = 0;
+}
+
+/*
+ * idmap_find - Return the slot holding id, or NULL if id is not live
+ */
+static idslot_t *
+idmap_find(idmap_t *map, uint64_t id)
+{
+	size_t i;
+
+	for (i = idmap_hash(map, id); map->slots[i].p != NULL;
+	     i = (i + 1) & map->mask)
+		if (map->slots[i].id == id)
+			return &map->slots[i];
+	return NULL;
+}
+
+/*
+ * idmap_insert - Return the slot for id, claiming an empty one if id is
+ *     not live.  The caller must store a non-NULL payload in a new slot
+ *     before the map is used again.
+ */
+static idslot_t *
+idmap_insert(idmap_t *map, uint64_t id)
+{
+	idslot_t *old;
+	size_t i, nslots;
+
+	/* Keep the load factor at or below one half. */
+	if (2 * (map->count + 1) > map->mask + 1) {
+		old = map->slots;
+		nslots = map->mask + 1;
+		if ((map->slots = (idslot_t *)calloc(2 * nslots,
+			 sizeof(idslot_t))) == NULL)
+			unix_error("calloc failed in idmap_insert");
+		map->mask = 2 * nslots - 1;
+		map->count = 0;
+		for (i = 0; i < nslots; i++) {
+			if (old[i].p != NULL)
+				*idmap_insert(map, old[i].id) = old[i];
+		}
+		free(old);
+	}
+
+	for (i = idmap_hash(map, id); map->slots[i].p != NULL;
+	     i = (i + 1) & map->mask)
+		if (map->slots[i].id == id)
+			return &map->slots[i];
+	map->slots[i].id = id;
+	map->count++;
+	return &map->slots[i];
+}
+
+/*
+ * idmap_remove - Empty a slot, shifting later members of its probe
+ *     sequence back so that lookups never need tombstones.
+ */
+static void
+idmap_remove(idmap_t *map, idslot_t *slot)
+{
+	size_t i = slot - map->slots;
+	size_t j = i;
+	size_t home;
+
+	for (;;) {
+		j = (j + 1) & map->mask;
+		if (map->slots[j].p == NULL)
+			break;
+		home = idmap_hash(map, map->slots[j].id);
+
+		/* The entry at j stays put if its home is in (i, j]. */
+		if ((i <= j) ? (i < home && home <= j) :
+			       (i < home || home <= j))
+			continue;
+		map->slots[i] = map->slots[j];
+		i = j;
+	}
+	map->slots[i].p = NULL;
+	map->count--;
+}
+
+/*
+ * idmap_free - Free the storage of an id map
+ */
+static void
+idmap_free(idmap_t *map)
+{
+	free(map->slots);
+	map->slots = NULL;
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -545,20 +1468,25 @@ free_trace(trace_t *trace)
 static int
 eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 {
-	unsigned i, j;
-	int index;
-	unsigned size;
-	unsigned oldsize;
+	uint64_t i;
+	size_t j;
+	size_t index;
+	size_t size;
+	size_t oldsize;
 	char *newp;
 	char *oldp;
 	char *p;
 
-	/* Reset the heap and free any records in the range list */
-	mem_reset_brk();
+	/*
+	 * Empty the heap, returning its pages so that the memory that the
+	 * trace touches can be measured, and free any records in the range
+	 * list
+	 */
+	mem_release();
 	clear_ranges(ranges);
 
 	/* Call the mm package's init function */
-	if (mm_init() < 0) {
+	if (engine->init() < 0) {
 		malloc_error(tracenum, 0, "mm_init failed.");
 		return 0;
 	}
@@ -573,7 +1501,7 @@ eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		case ALLOC: /* mm_malloc */
 
 			/* Call the student's malloc */
-			if ((p = mm_malloc(size)) == NULL) {
+			if ((p = engine->malloc(size)) == NULL) {
 				malloc_error(tracenum, i, "mm_malloc failed.");
 				return 0;
 			}
@@ -603,7 +1531,7 @@ eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
 			/* Call the student's realloc */
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, size)) == NULL) {
+			if ((newp = engine->realloc(oldp, size)) == NULL) {
 				malloc_error(tracenum, i, "mm_realloc failed.");
 				return 0;
 			}
@@ -625,7 +1553,7 @@ eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 			if (size < oldsize)
 				oldsize = size;
 			for (j = 0; j < oldsize; j++) {
-				if (newp[j] != (index & 0xFF)) {
+				if ((unsigned char)newp[j] != (index & 0xFF)) {
 					malloc_error(tracenum, i,
 					    "mm_realloc did not preserve the "
 					    "data from old block");
@@ -645,12 +1573,14 @@ eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 			 * function */
 			p = trace->blocks[index];
 			remove_range(ranges, p);
-			mm_free(p);
+			engine->free(p);
 			break;
 
 		default:
 			app_error("Nonexistent request type in eval_mm_valid");
 		}
+		if (!check_heap(tracenum, i))
+			return 0;
 	}
 
 	/* As far as we know, this is a valid malloc package */
@@ -658,34 +1588,66 @@ eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 }
 
 /*
- * eval_mm_util - Evaluate the space utilization of the student's package
- *   The idea is to remember the high water mark "hwm" of the heap for
- *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
- *
+ * record_memory - Record how much memory the heap holds after the checks
+ *     of a trace.  Because the checks start with a released heap and
+ *     write every payload, the resident bytes are what the trace really
+ *     touched, rather than what the break suggests.
  */
-static double
-eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static void
+record_memory(stats_t *stats)
+{
+	stats->heap = mem_heapsize();
+	stats->committed = mem_committed();
+	stats->resident = mem_resident();
+	stats->huge = mem_hugepages();
+}
+
+/*
+ * check_heap - Run the mm package's heap checker if request opnum ends a
+ *     group of check_every requests (-c).  Returns 0 if it found problems.
+ */
+static int
+check_heap(int tracenum, uint64_t opnum)
+{
+	if (check_every == 0 || (opnum + 1) % check_every != 0 ||
+	    engine->checkheap == NULL)
+		return 1;
+	if (engine->checkheap(verbose > 1) != 0) {
+		malloc_error(tracenum, opnum,
+		    "mm_checkheap found an inconsistent heap.");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * eval_mm_util - Evaluate the space utilization of the student's package
+ *   The idea is to remember the high water mark "hwm" of the heap for
+ *   an optimal allocator, i.e., no gaps and no internal fragmentation.
+ *   Utilization is the ratio hwm/heapsize, where heapsize is the
+ *   size of the heap in bytes after running the student's malloc
+ *   package on the trace. Note that our implementation of mem_sbrk()
+ *   doesn't allow the students to decrement the brk pointer, so brk
+ *   is always the high water mark of the heap.
+ *
+ */
+static double
+eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {
-	unsigned i;
-	int index;
-	unsigned size, newsize, oldsize;
-	int max_total_size = 0;
-	int total_size = 0;
+	uint64_t i;
+	size_t index;
+	size_t size, newsize, oldsize;
+	size_t max_total_size = 0;
+	size_t total_size = 0;
 	char *p;
 	char *newp, *oldp;
 
 	/* Remove the unused variable warnings */
-	(void)tracenum;
 	(void)ranges;
 
 	/* initialize the heap and the mm malloc package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (engine->init() < 0)
 		app_error("mm_init failed in eval_mm_util");
 
 	for (i = 0; i < trace->num_ops; i++) {
@@ -695,7 +1657,7 @@ eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
 
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = engine->malloc(size)) == NULL)
 				app_error("mm_malloc failed in eval_mm_util");
 
 			/* Remember region and size */
@@ -718,7 +1680,7 @@ eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			oldsize = trace->block_sizes[index];
 
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, newsize)) == NULL)
+			if ((newp = engine->realloc(oldp, newsize)) == NULL)
 				app_error("mm_realloc failed in eval_mm_util");
 
 			/* Remember region and size */
@@ -740,7 +1702,7 @@ eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			size = trace->block_sizes[index];
 			p = trace->blocks[index];
 
-			mm_free(p);
+			engine->free(p);
 
 			/* Keep track of current total size
 			 * of all allocated blocks */
@@ -751,11 +1713,217 @@ eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		default:
 			app_error("Nonexistent request type in eval_mm_util");
 		}
+
+		/* Sample the heap for the fragmentation profile (-F) */
+		if (frag_every > 0 &&
+		    ((i + 1) % frag_every == 0 || i + 1 == trace->num_ops))
+			sample_frag(tracenum, i + 1, total_size);
 	}
 
 	return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/*
+ * frag_visit - Add one block of the heap to a fragmentation sample.
+ *     Free block sizes are counted by power-of-two class: class k holds
+ *     the sizes from 32 << k up to twice that, and the last class holds
+ *     everything larger.
+ */
+static void
+frag_visit(void *blk, size_t size, int alloc, int cls, void *arg)
+{
+	frag_t *f = (frag_t *)arg;
+	int k;
+
+	(void)blk;
+	(void)cls;
+	if (alloc) {
+		f->alloc += size;
+		return;
+	}
+	f->free += size;
+	if (size > f->largest)
+		f->largest = size;
+	for (k = 0; k < FRAG_CLASSES - 1 && size >= (size_t)64 << k; k++)
+		;
+	f->by_class[k] += size;
+}
+
+/*
+ * sample_frag - Walk the heap after request opnum of trace tracenum and
+ *     write a line of the fragmentation profile (-F).  "live" is the
+ *     payload that the trace has allocated; alloc - live is the internal
+ *     fragmentation, free is the external fragmentation, and whatever is
+ *     left of heap is the mm package's own metadata.
+ */
+static void
+sample_frag(int tracenum, uint64_t opnum, size_t live)
+{
+	frag_t f;
+	int k;
+
+	memset(&f, 0, sizeof(f));
+	engine->heapwalk(frag_visit, &f);
+	fprintf(frag_fp, "%d,%" PRIu64 ",%zu,%zu,%zu,%zu,%zu", tracenum,
+	    opnum, mem_heapsize(), live, f.alloc, f.free, f.largest);
+	for (k = 0; k < FRAG_CLASSES; k++)
+		fprintf(frag_fp, ",%zu", f.by_class[k]);
+	fprintf(frag_fp, "\n");
+}
+
+/*
+ * eval_mm_snapshots - Replay a trace that is known to be valid and write
+ *     a heap snapshot (see snapshot.h) after each of the requests chosen
+ *     with -S.  The snapshot at the "peak" is taken after the request that
+ *     grew the heap to its final size; a first replay finds it.
+ */
+static void
+eval_mm_snapshots(trace_t *trace, int tracenum)
+{
+	uint64_t i, peak_op = 0;
+	size_t live = 0, heapsize = 0;
+	int next = 0;
+
+	if (snap_peak) {
+		mem_reset_brk();
+		if (engine->init() < 0)
+			app_error("mm_init failed in eval_mm_snapshots");
+		for (i = 0; i < trace->num_ops; i++) {
+			replay_op(trace, i, &live);
+			if (mem_heapsize() > heapsize) {
+				heapsize = mem_heapsize();
+				peak_op = i + 1;
+			}
+		}
+	}
+
+	mem_reset_brk();
+	if (engine->init() < 0)
+		app_error("mm_init failed in eval_mm_snapshots");
+	live = 0;
+	for (i = 0; i < trace->num_ops; i++) {
+		replay_op(trace, i, &live);
+		if ((next < num_snaps && snap_ops[next] == i + 1) ||
+		    i + 1 == peak_op)
+			write_snapshot(tracenum, i + 1, live);
+		while (next < num_snaps && snap_ops[next] <= i + 1)
+			next++;
+	}
+}
+
+/*
+ * replay_op - Replay request i of a trace through the mm package, and
+ *     keep *live up to date with the payload that the trace has allocated
+ */
+static void
+replay_op(trace_t *trace, uint64_t i, size_t *live)
+{
+	traceop_t *op = &trace->ops[i];
+	char *p;
+
+	switch (op->type) {
+	case ALLOC:
+		if ((p = engine->malloc(op->size)) == NULL)
+			app_error("mm_malloc failed in replay_op");
+		trace->blocks[op->index] = p;
+		trace->block_sizes[op->index] = op->size;
+		*live += op->size;
+		break;
+	case REALLOC:
+		if ((p = engine->realloc(trace->blocks[op->index], op->size)) == NULL)
+			app_error("mm_realloc failed in replay_op");
+		*live += op->size - trace->block_sizes[op->index];
+		trace->blocks[op->index] = p;
+		trace->block_sizes[op->index] = op->size;
+		break;
+	case FREE:
+		engine->free(trace->blocks[op->index]);
+		*live -= trace->block_sizes[op->index];
+		break;
+	default:
+		app_error("Nonexistent request type in replay_op");
+	}
+}
+
+/*
+ * snap_visit - Add one block of the heap to a snapshot.  Offsets are from
+ *     the first block, and the memlib regions that the blocks lie in are
+ *     added up as they are reached, since the blocks come in address order.
+ */
+static void
+snap_visit(void *blk, size_t size, int alloc, int cls, void *arg)
+{
+	snapwriter_t *w = (snapwriter_t *)arg;
+	snapshot_rec_t *rec = &w->batch[w->nbatch];
+	char *region;
+	size_t len;
+
+	if (w->heap_lo == NULL)
+		w->heap_lo = (char *)blk;
+	if ((char *)blk >= w->region_end &&
+	    (region = mem_region(blk, &len)) != NULL) {
+		w->seg_bytes += len;
+		w->region_end = region + len;
+	}
+	w->heap_end = (char *)blk + size;
+	rec->offset = (char *)blk - w->heap_lo;
+	rec->size = size;
+	rec->alloc = alloc;
+	rec->cls = alloc ? 0 : cls;
+	w->nblocks++;
+	if (++w->nbatch == SNAP_BATCH) {
+		if (fwrite(w->batch, sizeof(snapshot_rec_t), w->nbatch,
+			w->fp) != (size_t)w->nbatch)
+			unix_error("write failed in snap_visit");
+		w->nbatch = 0;
+	}
+}
+
+/*
+ * write_snapshot - Write a snapshot of the heap after request opnum of
+ *     trace tracenum to heap-<tracenum>-<opnum>.snap.  The header is
+ *     written last, once the number of blocks is known.
+ */
+static void
+write_snapshot(int tracenum, uint64_t opnum, size_t live)
+{
+	static snapwriter_t w;
+	snapshot_hdr_t hdr;
+	char path[MAXLINE];
+
+	sprintf(path, "heap-%d-%" PRIu64 ".snap", tracenum, opnum);
+	if ((w.fp = fopen(path, "w")) == NULL)
+		unix_error("Could not create a heap snapshot");
+	if (fseek(w.fp, sizeof(hdr), SEEK_SET) < 0)
+		unix_error("fseek failed in write_snapshot");
+	w.heap_lo = w.heap_end = w.region_end = NULL;
+	w.seg_bytes = 0;
+	w.nblocks = 0;
+	w.nbatch = 0;
+	engine->heapwalk(snap_visit, &w);
+	if (w.nbatch > 0 &&
+	    fwrite(w.batch, sizeof(snapshot_rec_t), w.nbatch, w.fp) !=
+		(size_t)w.nbatch)
+		unix_error("write failed in write_snapshot");
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.rec_size = sizeof(snapshot_rec_t);
+	hdr.tracenum = tracenum;
+	hdr.opnum = opnum;
+	hdr.heapsize = mem_heapsize();
+	hdr.span = w.heap_end - w.heap_lo;
+	hdr.seg_bytes = w.seg_bytes;
+	hdr.live = live;
+	hdr.nblocks = w.nblocks;
+	rewind(w.fp);
+	if (fwrite(&hdr, sizeof(hdr), 1, w.fp) != 1 || fclose(w.fp) != 0)
+		unix_error("write failed in write_snapshot");
+	if (verbose > 1)
+		printf("Wrote %s (%" PRIu64 " blocks)\n", path, w.nblocks);
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
@@ -763,13 +1931,14 @@ eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 static void
 eval_mm_speed(void *ptr)
 {
-	unsigned i, index, size, newsize;
+	uint64_t i;
+	size_t index, size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 
 	/* Reset the heap and initialize the mm package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (engine->init() < 0)
 		app_error("mm_init failed in eval_mm_speed");
 
 	/* Interpret each trace request */
@@ -779,7 +1948,7 @@ eval_mm_speed(void *ptr)
 		case ALLOC: /* mm_malloc */
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = engine->malloc(size)) == NULL)
 				app_error("mm_malloc error in eval_mm_speed");
 			trace->blocks[index] = p;
 			break;
@@ -788,7 +1957,7 @@ eval_mm_speed(void *ptr)
 			index = trace->ops[i].index;
 			newsize = trace->ops[i].size;
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, newsize)) == NULL)
+			if ((newp = engine->realloc(oldp, newsize)) == NULL)
 				app_error("mm_realloc error in eval_mm_speed");
 			trace->blocks[index] = newp;
 			break;
@@ -796,7 +1965,7 @@ eval_mm_speed(void *ptr)
 		case FREE: /* mm_free */
 			index = trace->ops[i].index;
 			block = trace->blocks[index];
-			mm_free(block);
+			engine->free(block);
 			break;
 
 		default:
@@ -804,94 +1973,1870 @@ eval_mm_speed(void *ptr)
 		}
 }
 
-/*************************************
- * Some miscellaneous helper routines
- ************************************/
+/*
+ * time_speed - Time f, eval_mm_speed or eval_libc_speed, with fsecs()
+ *     or, with -B, with the benchmark runner, and record the hardware
+ *     events it counted (-P)
+ */
+static void
+time_speed(fsecs_test_funct f, speed_t *speed_params, stats_t *stats)
+{
+	if (use_bench)
+		stats->secs = fsecs_bench(f, speed_params, &stats->bench);
+	else
+		stats->secs = fsecs(f, speed_params);
+	memcpy(stats->events, counters.counts, sizeof(counters.counts));
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * eval_libc_speed - This is the function that is used by fcyc() to
+ *     measure the running time of the libc malloc package, or another
+ *     engine that does not allocate from memlib's heap, on a trace.  The
+ *     blocks that are still allocated at the end of the trace are freed,
+ *     so that every run starts with the same heap.
  */
 static void
-printresults(int n, stats_t *stats)
+eval_libc_speed(void *ptr)
 {
-	int i;
-	double secs = 0;
-	double ops = 0;
-	double util = 0;
+	uint64_t i;
+	size_t index, size, newsize;
+	char *p, *newp, *oldp;
+	trace_t *trace = ((speed_t *)ptr)->trace;
 
-	/* Print the individual results for each trace */
-	/* All the space before the last number on each line is added by
-	 * Zheng Cai, for better formatting */
-	printf("%5s%7s %5s%8s%10s %6s\n", "trace", " valid", "util", "ops",
-	    "secs", "Kops");
-	for (i = 0; i < n; i++) {
-		if (stats[i].valid) {
-			printf("%2d%10s%5.0f%%%8.0f%10.6f %6.0f\n", i, "yes",
-			    stats[i].util * 100.0, stats[i].ops, stats[i].secs,
-			    (stats[i].ops / 1e3) / stats[i].secs);
-			secs += stats[i].secs;
-			ops += stats[i].ops;
-			util += stats[i].util;
-		} else {
-			printf("%2d%10s%6s%8s%10s %6s\n", i, "no", "-", "-",
-			    "-", "-");
+	for (i = 0; i < trace->num_ops; i++)
+		switch (trace->ops[i].type) {
+
+		case ALLOC: /* malloc */
+			index = trace->ops[i].index;
+			size = trace->ops[i].size;
+			/* libc may return NULL for malloc(0) */
+			if ((p = engine->malloc(size)) == NULL && size > 0)
+				unix_error("malloc failed in eval_libc_speed");
+			trace->blocks[index] = p;
+			break;
+
+		case REALLOC: /* realloc */
+			index = trace->ops[i].index;
+			newsize = trace->ops[i].size;
+			oldp = trace->blocks[index];
+			/* ... and realloc(p, 0) may free p and return NULL */
+			if ((newp = engine->realloc(oldp, newsize)) == NULL &&
+			    newsize > 0)
+				unix_error("realloc failed in eval_libc_speed");
+			trace->blocks[index] = newp;
+			break;
+
+		case FREE: /* free */
+			index = trace->ops[i].index;
+			engine->free(trace->blocks[index]);
+			trace->blocks[index] = NULL;
+			break;
+
+		default:
+			app_error("Nonexistent request type in eval_libc_speed");
 		}
+
+	for (i = 0; i < trace->num_ids; i++) {
+		engine->free(trace->blocks[i]);
+		trace->blocks[i] = NULL;
 	}
+}
 
-	/* Print the aggregate results for the set of traces */
-	if (errors == 0) {
-		printf("%12s%5.0f%%%8.0f%10.6f %6.0f\n", "Total       ",
-		    (util / n) * 100.0, ops, secs, (ops / 1e3) / secs);
-	} else {
-		printf("%12s%6s%8s%10s %6s\n", "Total       ", "-", "-", "-",
-		    "-");
+/*
+ * eval_libc - Time the replay of a trace through the libc malloc
+ *     package (-l), or engine e, in the same way as the mm malloc package
+ */
+static void
+eval_libc(const engine_t *e, trace_t *trace, stats_t *stats)
+{
+	speed_t speed_params;
+	const engine_t *saved = engine;
+
+	/* The blocks still point into the simulated heap */
+	memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+	speed_params.trace = trace;
+	speed_params.ranges = NULL;
+	stats->valid = 1;
+	stats->ops = trace->num_ops;
+	engine = e;
+	if (engine->init() < 0)
+		app_error("init failed in eval_libc");
+	time_speed(eval_libc_speed, &speed_params, stats);
+	engine = saved;
+}
+
+/*
+ * eval_mm_latency - Replay a trace once more, timing each request on its
+ *     own, and record the latencies of mm_malloc, mm_free, and mm_realloc
+ *     in hists[ALLOC], hists[FREE], and hists[REALLOC], in ticks of
+ *     read_counter().  The cost of reading the counter is subtracted.
+ *     This is not part of eval_mm_speed so that the timestamps do not
+ *     slow down the throughput measurement.
+ */
+static void
+eval_mm_latency(trace_t *trace, lathist_t *hists)
+{
+	uint64_t i, t0, t1, ovhd, lat;
+	traceop_t *op;
+	char *p;
+
+	/* The counter's own cost is the fastest back-to-back reading. */
+	ovhd = UINT64_MAX;
+	for (i = 0; i < 1000; i++) {
+		t0 = read_counter();
+		t1 = read_counter();
+		ovhd = (t1 - t0 < ovhd) ? t1 - t0 : ovhd;
+	}
+
+	/* Reset the heap and initialize the mm package */
+	mem_reset_brk();
+	if (engine->init() < 0)
+		app_error("mm_init failed in eval_mm_latency");
+
+	/* Interpret and time each trace request */
+	for (i = 0; i < trace->num_ops; i++) {
+		op = &trace->ops[i];
+		switch (op->type) {
+
+		case ALLOC: /* mm_malloc */
+			t0 = read_counter();
+			p = engine->malloc(op->size);
+			t1 = read_counter();
+			if (p == NULL)
+				app_error("mm_malloc error in eval_mm_latency");
+			trace->blocks[op->index] = p;
+			break;
+
+		case REALLOC: /* mm_realloc */
+			t0 = read_counter();
+			p = engine->realloc(trace->blocks[op->index], op->size);
+			t1 = read_counter();
+			if (p == NULL)
+				app_error("mm_realloc error in eval_mm_latency");
+			trace->blocks[op->index] = p;
+			break;
+
+		case FREE: /* mm_free */
+			t0 = read_counter();
+			engine->free(trace->blocks[op->index]);
+			t1 = read_counter();
+			break;
+
+		default:
+			app_error("Nonexistent request type in eval_mm_latency");
+		}
+		lat = t1 - t0;
+		lathist_add(&hists[op->type], (lat > ovhd) ? lat - ovhd : 0);
 	}
 }
 
 /*
- * app_error - Report an arbitrary application error
+ * check_stream_block - The streaming counterpart of add_range.  Checks
+ *     that a new payload is aligned and lies within the heap.  A streamed
+ *     trace may have too many live blocks to compare every new payload
+ *     against all of the others, so overlaps are instead caught when a
+ *     block's fill pattern is found to be overwritten (see
+ *     eval_mm_valid_stream).
  */
-void
-app_error(char *msg)
+static int
+check_stream_block(char *lo, size_t size, int tracenum, uint64_t opnum)
 {
-	printf("%s\n", msg);
-	exit(1);
+	char *hi = lo + size - 1;
+
+	if (!IS_ALIGNED(lo)) {
+		sprintf(msg, "Payload address (%p) not aligned to %d bytes", lo,
+		    ALIGNMENT);
+		malloc_error(tracenum, opnum, msg);
+		return 0;
+	}
+	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+	    (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+		sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)", lo,
+		    hi, mem_heap_lo(), mem_heap_hi());
+		malloc_error(tracenum, opnum, msg);
+		return 0;
+	}
+	return 1;
 }
 
 /*
- * unix_error - Report a Unix-style error
+ * eval_mm_valid_stream - Check the mm malloc package for correctness on
+ *     a streamed trace, and measure its space utilization in the same
+ *     pass, since every pass over a streamed trace costs a full read of
+ *     it (and a piped trace can only be read once).  Fills in the ops
+ *     and util fields of *stats.
  */
-void
-unix_error(char *msg)
+static int
+eval_mm_valid_stream(stream_t *s, int tracenum, stats_t *stats)
 {
-	printf("%s: %s\n", msg, strerror(errno));
-	exit(1);
+	idmap_t map;
+	idslot_t *slot;
+	traceop_t *op;
+	uint64_t opnum = 0;
+	size_t i, j, n, size, oldsize;
+	size_t total_size = 0, max_total_size = 0;
+	unsigned char fill;
+	char *p;
+	int valid = 0;
+
+	/* Empty the heap, as eval_mm_valid does, and initialize the package */
+	mem_release();
+	if (engine->init() < 0) {
+		malloc_error(tracenum, 0, "mm_init failed.");
+		return 0;
+	}
+	idmap_init(&map);
+
+	/* Interpret each operation in the trace in order */
+	while ((n = read_stream(s)) > 0) {
+		for (i = 0; i < n; i++, opnum++) {
+			op = &s->chunk[i];
+			size = op->size;
+			fill = op->index & 0xFF;
+
+			switch (op->type) {
+
+			case ALLOC: /* mm_malloc */
+				if ((p = engine->malloc(size)) == NULL) {
+					malloc_error(tracenum, opnum,
+					    "mm_malloc failed.");
+					goto out;
+				}
+				if (!check_stream_block(p, size, tracenum,
+					opnum))
+					goto out;
+				memset(p, fill, size);
+				slot = idmap_insert(&map, op->index);
+				slot->p = p;
+				slot->size = size;
+				total_size += size;
+				break;
+
+			case REALLOC: /* mm_realloc */
+				if ((slot = idmap_find(&map, op->index)) ==
+				    NULL)
+					app_error("Realloc of a dead id in "
+						  "streamed trace");
+				if ((p = engine->realloc(slot->p, size)) == NULL) {
+					malloc_error(tracenum, opnum,
+					    "mm_realloc failed.");
+					goto out;
+				}
+				if (!check_stream_block(p, size, tracenum,
+					opnum))
+					goto out;
+
+				/* The old data must have been copied. */
+				oldsize = slot->size;
+				if (size < oldsize)
+					oldsize = size;
+				for (j = 0; j < oldsize; j++) {
+					if ((unsigned char)p[j] != fill) {
+						malloc_error(tracenum, opnum,
+						    "mm_realloc did not "
+						    "preserve the data from "
+						    "old block");
+						goto out;
+					}
+				}
+				memset(p, fill, size);
+				total_size += size - slot->size;
+				slot->p = p;
+				slot->size = size;
+				break;
+
+			case FREE: /* mm_free */
+				if ((slot = idmap_find(&map, op->index)) ==
+				    NULL)
+					app_error("Free of a dead id in "
+						  "streamed trace");
+
+				/*
+				 * If another payload overlapped this one,
+				 * writing its fill pattern will likely have
+				 * overwritten one end of this payload.
+				 */
+				if ((unsigned char)slot->p[0] != fill ||
+				    (unsigned char)slot->p[slot->size - 1] !=
+					fill) {
+					malloc_error(tracenum, opnum,
+					    "Payload was overwritten while "
+					    "allocated (overlapping "
+					    "payloads?)");
+					goto out;
+				}
+				engine->free(slot->p);
+				total_size -= slot->size;
+				idmap_remove(&map, slot);
+				break;
+
+			default:
+				app_error("Nonexistent request type in "
+					  "eval_mm_valid_stream");
+			}
+			if (!check_heap(tracenum, opnum))
+				goto out;
+			max_total_size = (total_size > max_total_size) ?
+			    total_size :
+			    max_total_size;
+		}
+	}
+
+	/* As far as we know, this is a valid malloc package */
+	stats->ops = opnum;
+	record_memory(stats);
+	stats->util = (double)max_total_size / (double)mem_heapsize();
+	valid = 1;
+out:
+	idmap_free(&map);
+	return valid;
 }
 
 /*
- * malloc_error - Report an error returned by the mm_malloc package
+ * eval_mm_speed_stream - Return the running time of the mm malloc
+ *     package on a streamed trace, in seconds.  Only the replay of each
+ *     chunk is timed, not reading it, and the trace is replayed once
+ *     rather than the several times that fsecs() would.
  */
-void
-malloc_error(int tracenum, int opnum, char *msg)
+static double
+eval_mm_speed_stream(stream_t *s)
 {
-	errors++;
-	printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum),
-	    msg);
+	idmap_t map;
+	idslot_t *slot;
+	traceop_t *op;
+	struct timespec start, end;
+	double secs = 0;
+	size_t i, n;
+	char *p;
+
+	if (rewind_stream(s) < 0)
+		app_error("Cannot rewind a piped trace for eval_mm_speed_stream");
+
+	/* Reset the heap and initialize the mm package */
+	mem_reset_brk();
+	if (engine->init() < 0)
+		app_error("mm_init failed in eval_mm_speed_stream");
+	idmap_init(&map);
+
+	/* Interpret each trace request */
+	if (use_counters)
+		perfctr_begin(&counters);
+	while ((n = read_stream(s)) > 0) {
+		if (use_counters)
+			perfctr_enable();
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < n; i++) {
+			op = &s->chunk[i];
+			switch (op->type) {
+
+			case ALLOC: /* mm_malloc */
+				if ((p = engine->malloc(op->size)) == NULL)
+					app_error("mm_malloc error in "
+						  "eval_mm_speed_stream");
+				slot = idmap_insert(&map, op->index);
+				slot->p = p;
+				break;
+
+			case REALLOC: /* mm_realloc */
+				slot = idmap_find(&map, op->index);
+				if ((p = engine->realloc(slot->p, op->size)) == NULL)
+					app_error("mm_realloc error in "
+						  "eval_mm_speed_stream");
+				slot->p = p;
+				break;
+
+			case FREE: /* mm_free */
+				slot = idmap_find(&map, op->index);
+				engine->free(slot->p);
+				idmap_remove(&map, slot);
+				break;
+
+			default:
+				app_error("Nonexistent request type in "
+					  "eval_mm_speed_stream");
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (use_counters)
+			perfctr_disable();
+		secs += (end.tv_sec - start.tv_sec) +
+		    1e-9 * (end.tv_nsec - start.tv_nsec);
+	}
+	if (use_counters)
+		perfctr_end(&counters, 1);
+
+	idmap_free(&map);
+	return secs;
 }
 
 /*
- * usage - Explain the command line arguments
+ * eval_mm_stream - Evaluate the mm malloc package on one streamed trace.
+ *     A piped trace can only be read once, so its throughput is not
+ *     measured.
  */
 static void
-usage(void)
+eval_mm_stream(char *tracedir, char *filename, int tracenum, stats_t *stats)
 {
-	fprintf(stderr, "Usage: mdriver [-aghvV] [-f <file>] [-t <dir>]\n");
-	fprintf(stderr, "Options\n");
-	fprintf(stderr, "\t-a         Don't check the team structure.\n");
-	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
-	fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
-	fprintf(stderr, "\t-h         Print this message.\n");
-	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	stream_t *s = open_stream(tracedir, filename);
+
+	if (verbose > 1)
+		printf("Checking mm_malloc for correctness, efficiency, ");
+	stats->valid = eval_mm_valid_stream(s, tracenum, stats);
+	if (stats->valid) {
+		if (s->seekable) {
+			if (verbose > 1)
+				printf("and performance.\n");
+			stats->secs = eval_mm_speed_stream(s);
+			memcpy(stats->events, counters.counts,
+			    sizeof(counters.counts));
+		} else if (verbose > 1)
+			printf("but not performance of a piped trace.\n");
+	}
+	close_stream(s);
+}
+
+/*
+ * eval_mm_checks - Check one trace for correctness and measure its space
+ *     utilization.  This is the part of a trace's evaluation that may run
+ *     in a worker process.
+ */
+static void
+eval_mm_checks(char *filename, int tracenum, int stream, stats_t *stats)
+{
+	trace_t *trace;
+	range_t *ranges = NULL;
+	stream_t *s;
+
+	if (stream) {
+		s = open_stream(tracedir, filename);
+		stats->valid = eval_mm_valid_stream(s, tracenum, stats);
+		close_stream(s);
+		return;
+	}
+	trace = read_trace(tracedir, filename);
+	stats->ops = trace->num_ops;
+	stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+	record_memory(stats);
+	if (stats->valid) {
+		stats->util = eval_mm_util(trace, tracenum, &ranges);
+		if (num_snaps > 0 || snap_peak)
+			eval_mm_snapshots(trace, tracenum);
+	}
+	clear_ranges(&ranges);
+	free_trace(trace);
+}
+
+/*
+ * eval_mm_timing - Measure the running time of one trace that has
+ *     already passed eval_mm_checks.
+ */
+static void
+eval_mm_timing(char *filename, int tracenum, int stream, stats_t *stats)
+{
+	speed_t speed_params;
+	stream_t *s;
+
+	if (stream) {
+		s = open_stream(tracedir, filename);
+		if (s->seekable) {
+			stats->secs = eval_mm_speed_stream(s);
+			memcpy(stats->events, counters.counts,
+			    sizeof(counters.counts));
+		}
+		close_stream(s);
+		return;
+	}
+	speed_params.trace = read_trace(tracedir, filename);
+	speed_params.ranges = NULL;
+	time_speed(eval_mm_speed, &speed_params, stats);
+	if (lat_hists != NULL)
+		eval_mm_latency(speed_params.trace, lat_hists[tracenum]);
+	if (libc_stats != NULL)
+		eval_libc(&libc_engine, speed_params.trace,
+		    &libc_stats[tracenum]);
+	free_trace(speed_params.trace);
+}
+
+/*
+ * eval_mm_parallel - Evaluate the traces with up to "jobs" worker
+ *     processes checking correctness and utilization at the same time.
+ *     Each worker is a fork of the driver, so it has its own copy of the
+ *     simulated heap in memlib.c.  The workers send their results back
+ *     through pipes.  Timing runs would disturb each other, so once all
+ *     of the workers are done, the driver times the valid traces itself,
+ *     one at a time, pinned to the CPU it is running on.
+ */
+static void
+eval_mm_parallel(char **tracefiles, int num_tracefiles, int jobs,
+    int stream, stats_t *stats)
+{
+	pid_t *pids;
+	int *fds;
+	int fd[2];
+	int i, next, running, status;
+	job_result_t result;
+	cpu_set_t oldmask, mask;
+	pid_t pid;
+
+	if ((pids = (pid_t *)calloc(num_tracefiles, sizeof(pid_t))) == NULL ||
+	    (fds = (int *)calloc(num_tracefiles, sizeof(int))) == NULL)
+		unix_error("calloc failed in eval_mm_parallel");
+
+	if (verbose > 1)
+		printf("Checking %d traces with up to %d workers\n",
+		    num_tracefiles, jobs);
+
+	/* Keep up to "jobs" workers busy until every trace is checked. */
+	next = 0;
+	running = 0;
+	while (next < num_tracefiles || running > 0) {
+		while (next < num_tracefiles && running < jobs) {
+			if (pipe(fd) < 0)
+				unix_error("pipe failed in eval_mm_parallel");
+
+			/* Don't let the worker inherit unflushed output. */
+			fflush(stdout);
+			if ((pid = fork()) < 0)
+				unix_error("fork failed in eval_mm_parallel");
+			if (pid == 0) {
+				close(fd[0]);
+				memset(&result, 0, sizeof(result));
+				eval_mm_checks(tracefiles[next], next, stream,
+				    &result.stats);
+				result.errors = errors;
+				if (write(fd[1], &result, sizeof(result)) !=
+				    sizeof(result))
+					unix_error("write failed in worker");
+				fflush(stdout);
+				_exit(0);
+			}
+			close(fd[1]);
+			pids[next] = pid;
+			fds[next] = fd[0];
+			next++;
+			running++;
+		}
+
+		/* Collect the results of whichever worker finishes next. */
+		if ((pid = wait(&status)) < 0)
+			unix_error("wait failed in eval_mm_parallel");
+		for (i = 0; i < num_tracefiles && pids[i] != pid; i++)
+			;
+		if (i == num_tracefiles)
+			continue;
+		running--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+		    read(fds[i], &result, sizeof(result)) == sizeof(result)) {
+			stats[i] = result.stats;
+			errors += result.errors;
+		} else {
+			stats[i].valid = 0;
+			errors++;
+			printf("ERROR [trace %d]: worker died (%s %d)\n", i,
+			    WIFSIGNALED(status) ? "signal" : "exit status",
+			    WIFSIGNALED(status) ? WTERMSIG(status) :
+						  WEXITSTATUS(status));
+		}
+		close(fds[i]);
+	}
+
+	/* Time the valid traces one after another on a single CPU. */
+	sched_getaffinity(0, sizeof(oldmask), &oldmask);
+	CPU_ZERO(&mask);
+	CPU_SET(sched_getcpu(), &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) < 0 && verbose > 1)
+		printf("Could not pin the timing runs to a CPU\n");
+	for (i = 0; i < num_tracefiles; i++) {
+		if (!stats[i].valid)
+			continue;
+		if (verbose > 1)
+			printf("Measuring performance of %s\n", tracefiles[i]);
+		eval_mm_timing(tracefiles[i], i, stream, &stats[i]);
+	}
+	sched_setaffinity(0, sizeof(oldmask), &oldmask);
+
+	free(pids);
+	free(fds);
+}
+
+/*
+ * The mm package is not thread-safe, so the threads of the scaling
+ * benchmark serialize their calls into it with this lock.  The scaling
+ * that is measured is therefore that of the package plus the lock.
+ */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * mt_replay - The body of one thread of the scaling benchmark: wait for
+ *     the other threads, then replay this thread's requests.  A request
+ *     that fails stops the thread with out_of_heap set, since the threads
+ *     together can need more heap than any one trace does.
+ */
+static void *
+mt_replay(void *arg)
+{
+	mt_thread_t *t = (mt_thread_t *)arg;
+	struct timespec start, end;
+	traceop_t *op;
+	uint64_t i;
+	char *p;
+
+	t->out_of_heap = 0;
+	pthread_barrier_wait(t->barrier);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < t->num_ops; i++) {
+		op = &t->ops[i];
+		pthread_mutex_lock(&mm_lock);
+		switch (op->type) {
+		case ALLOC: /* mm_malloc */
+			p = engine->malloc(op->size);
+			break;
+		case REALLOC: /* mm_realloc */
+			p = engine->realloc(t->blocks[op->index], op->size);
+			break;
+		default: /* mm_free */
+			engine->free(t->blocks[op->index]);
+			p = NULL;
+			break;
+		}
+		pthread_mutex_unlock(&mm_lock);
+		if (op->type != FREE && p == NULL) {
+			t->out_of_heap = 1;
+			break;
+		}
+		t->blocks[op->index] = p;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	t->start = start.tv_sec + 1e-9 * start.tv_nsec;
+	t->secs = (end.tv_sec - start.tv_sec) +
+	    1e-9 * (end.tv_nsec - start.tv_nsec);
+	return NULL;
+}
+
+/*
+ * run_mm_threads - Replay the requests of nthreads threads against a
+ *     fresh heap at the same time, MT_REPS times, and return the best
+ *     aggregate throughput in ops/sec.  The per-thread times of the best
+ *     run are left in threads[].  Returns 0 if the threads ran out of heap.
+ */
+static double
+run_mm_threads(mt_thread_t *threads, int nthreads, uint64_t num_ops)
+{
+	pthread_barrier_t barrier;
+	pthread_t *tids;
+	double *best_secs;
+	double first, last, rate, best = 0;
+	int rep, t;
+
+	if ((tids = (pthread_t *)calloc(nthreads, sizeof(pthread_t))) ==
+		NULL ||
+	    (best_secs = (double *)calloc(nthreads, sizeof(double))) == NULL)
+		unix_error("calloc failed in run_mm_threads");
+
+	for (rep = 0; rep < MT_REPS; rep++) {
+		mem_reset_brk();
+		if (engine->init() < 0)
+			app_error("mm_init failed in run_mm_threads");
+		pthread_barrier_init(&barrier, NULL, nthreads);
+		for (t = 0; t < nthreads; t++) {
+			threads[t].barrier = &barrier;
+			if (pthread_create(&tids[t], NULL, mt_replay,
+				&threads[t]) != 0)
+				app_error("pthread_create failed");
+		}
+		for (t = 0; t < nthreads; t++)
+			pthread_join(tids[t], NULL);
+		pthread_barrier_destroy(&barrier);
+		for (t = 0; t < nthreads && !threads[t].out_of_heap; t++)
+			;
+		if (t < nthreads) {
+			best = 0;
+			break;
+		}
+
+		/* The run lasts from the first start to the last finish. */
+		first = DBL_MAX;
+		last = 0;
+		for (t = 0; t < nthreads; t++) {
+			if (threads[t].start < first)
+				first = threads[t].start;
+			if (threads[t].start + threads[t].secs > last)
+				last = threads[t].start + threads[t].secs;
+		}
+		rate = num_ops / (last - first);
+		if (rate > best) {
+			best = rate;
+			for (t = 0; t < nthreads; t++)
+				best_secs[t] = threads[t].secs;
+		}
+	}
+	for (t = 0; t < nthreads && best > 0; t++)
+		threads[t].secs = best_secs[t];
+	free(best_secs);
+	free(tids);
+	return best;
+}
+
+/*
+ * print_scaling - Print one row of the scaling table.  Fairness is
+ *     Jain's index of the per-thread throughputs, which is 1 when every
+ *     thread got the same rate and 1/nthreads when one thread got it all.
+ */
+static void
+print_scaling(mt_thread_t *threads, int nthreads, double rate, double base)
+{
+	double r, sum = 0, sumsq = 0, lo = DBL_MAX, hi = 0;
+	int t;
+
+	for (t = 0; t < nthreads; t++) {
+		r = threads[t].num_ops / threads[t].secs;
+		sum += r;
+		sumsq += r * r;
+		lo = (r < lo) ? r : lo;
+		hi = (r > hi) ? r : hi;
+	}
+	printf("%7d %10.0f %8.2f %9.3f %8.3f\n", nthreads, rate / 1e3,
+	    rate / base, (sum * sum) / (nthreads * sumsq), lo / hi);
+}
+
+/*
+ * eval_mm_scaling - Measure the aggregate throughput of the mm malloc
+ *     package on 1..ncpu threads sharing one heap.  With shard set, each
+ *     valid trace is split by id, with thread t replaying the blocks
+ *     whose id is t modulo the number of threads.  Otherwise, thread t
+ *     replays the whole of valid trace t modulo the number of traces,
+ *     with its own blocks array.
+ */
+static void
+eval_mm_scaling(char **tracefiles, int num_tracefiles, int shard,
+    stats_t *stats)
+{
+	trace_t **traces;
+	mt_thread_t *threads;
+	uint64_t i, num_ops, *counts;
+	double rate, base;
+	int ncpu, n, nthreads, t, tr;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	ncpu = (ncpu < 1) ? 1 : ncpu;
+	if ((traces = (trace_t **)calloc(num_tracefiles,
+		 sizeof(trace_t *))) == NULL ||
+	    (threads = (mt_thread_t *)calloc(ncpu, sizeof(mt_thread_t))) ==
+		NULL ||
+	    (counts = (uint64_t *)calloc(ncpu, sizeof(uint64_t))) == NULL)
+		unix_error("calloc failed in eval_mm_scaling");
+
+	/* Only valid traces are safe to replay without checks. */
+	for (n = 0, tr = 0; tr < num_tracefiles; tr++)
+		if (stats[tr].valid)
+			traces[n++] = read_trace(tracedir, tracefiles[tr]);
+	if (n == 0)
+		printf("No valid traces to measure scaling with\n");
+	else
+		printf("\nScaling of mm malloc (%s, lock-serialized):\n",
+		    shard ? "each trace sharded by id" : "one trace per thread");
+	for (tr = 0; tr < (shard ? n : (n > 0)); tr++) {
+		if (shard)
+			printf("trace %d:\n", tr);
+		printf("%7s %10s %8s %9s %8s\n", "threads", "Kops", "speedup",
+		    "fairness", "min/max");
+		base = 0;
+		for (nthreads = 1; nthreads <= ncpu; nthreads++) {
+			num_ops = 0;
+			for (t = 0; t < nthreads; t++) {
+				trace_t *trace = shard ? traces[tr] :
+							 traces[t % n];
+
+				if (shard) {
+					threads[t].blocks = trace->blocks;
+					counts[t] = 0;
+					continue;
+				}
+				threads[t].ops = trace->ops;
+				threads[t].num_ops = trace->num_ops;
+				if ((threads[t].blocks = (char **)calloc(
+					 trace->num_ids, sizeof(char *))) ==
+				    NULL)
+					unix_error("calloc failed in "
+						   "eval_mm_scaling");
+				num_ops += trace->num_ops;
+			}
+
+			/* Deal the requests out to the shards by id. */
+			if (shard) {
+				for (i = 0; i < traces[tr]->num_ops; i++)
+					counts[traces[tr]->ops[i].index %
+					    nthreads]++;
+				for (t = 0; t < nthreads; t++) {
+					if ((threads[t].ops = (traceop_t *)
+						    malloc((counts[t] + 1) *
+							sizeof(traceop_t))) ==
+					    NULL)
+						unix_error("malloc failed in "
+							   "eval_mm_scaling");
+					threads[t].num_ops = 0;
+				}
+				for (i = 0; i < traces[tr]->num_ops; i++) {
+					t = traces[tr]->ops[i].index % nthreads;
+					threads[t].ops[threads[t].num_ops++] =
+					    traces[tr]->ops[i];
+				}
+				num_ops = traces[tr]->num_ops;
+			}
+
+			rate = run_mm_threads(threads, nthreads, num_ops);
+			base = (nthreads == 1) ? rate : base;
+			if (rate > 0)
+				print_scaling(threads, nthreads, rate, base);
+			else
+				printf("%7d  out of heap; stopping (raise -M "
+				       "to go further)\n",
+				    nthreads);
+
+			for (t = 0; t < nthreads; t++) {
+				if (shard)
+					free(threads[t].ops);
+				else
+					free(threads[t].blocks);
+			}
+			if (rate == 0)
+				break;
+		}
+	}
+
+	for (tr = 0; tr < n; tr++)
+		free_trace(traces[tr]);
+	free(traces);
+	free(threads);
+	free(counts);
+}
+
+/*
+ * eval_engines - Score each of the nsel engines in sel on every trace, and
+ *     print their results side by side.  The engines take turns trace by
+ *     trace, so that a change in the load of the machine affects them all
+ *     alike.  An engine that does not allocate from memlib's heap is only
+ *     timed, as libc malloc is with -l.
+ */
+static void
+eval_engines(char **tracefiles, int num_tracefiles, const engine_t **sel,
+    int nsel)
+{
+	trace_t *trace;
+	range_t *ranges = NULL;
+	speed_t speed_params;
+	stats_t *stats, *st;
+	int i, e;
+
+	if ((stats = calloc(nsel * num_tracefiles, sizeof(stats_t))) == NULL)
+		unix_error("calloc failed in eval_engines");
+
+	for (i = 0; i < num_tracefiles; i++) {
+		trace = read_trace(tracedir, tracefiles[i]);
+		for (e = 0; e < nsel; e++) {
+			st = &stats[e * num_tracefiles + i];
+			st->ops = trace->num_ops;
+			if (!sel[e]->checked) {
+				eval_libc(sel[e], trace, st);
+				continue;
+			}
+			engine = sel[e];
+			if (verbose > 1)
+				printf("Checking %s on %s\n", engine->name,
+				    tracefiles[i]);
+			if (!(st->valid = eval_mm_valid(trace, i, &ranges)))
+				continue;
+			st->util = eval_mm_util(trace, i, &ranges);
+			speed_params.trace = trace;
+			speed_params.ranges = ranges;
+			time_speed(eval_mm_speed, &speed_params, st);
+		}
+		free_trace(trace);
+	}
+	engine = &mm_engine;
+	clear_ranges(&ranges);
+
+	printengines(num_tracefiles, sel, nsel, stats);
+	free(stats);
+}
+
+/*
+ * eval_mm_tune - Score the mm package on every trace under every policy
+ *     that the values of the knobs given with -T make, and print the
+ *     policies sorted by throughput, marking those on the Pareto front of
+ *     throughput and utilization.  Knobs that are not swept keep the value
+ *     they have in the environment.
+ */
+static void
+eval_mm_tune(char **tracefiles, int num_tracefiles)
+{
+	trace_t **traces;
+	range_t *ranges = NULL;
+	speed_t speed_params;
+	stats_t stats;
+	mm_config_t base;
+	tune_t *tune, *t, *u;
+	int ntune, i, j, k, idx, nfront;
+	double secs, ops, p2;
+
+	if ((traces = calloc(num_tracefiles, sizeof(trace_t *))) == NULL)
+		unix_error("calloc failed in eval_mm_tune");
+	for (i = 0; i < num_tracefiles; i++)
+		traces[i] = read_trace(tracedir, tracefiles[i]);
+
+	/* Every combination of the swept values */
+	mm_get_config(&base);
+	for (ntune = 1, k = 0; k < TUNE_KNOBS; k++)
+		ntune *= (tune_nvals[k] > 0) ? tune_nvals[k] : 1;
+	if ((tune = calloc(ntune, sizeof(tune_t))) == NULL)
+		unix_error("calloc failed in eval_mm_tune");
+	printf("Tuning %d policies on %d traces\n", ntune, num_tracefiles);
+
+	for (j = 0; j < ntune; j++) {
+		t = &tune[j];
+		t->config = base;
+		for (idx = j, k = 0; k < TUNE_KNOBS; k++) {
+			if (tune_nvals[k] == 0)
+				continue;
+			set_knob(&t->config, k, tune_vals[k][idx % tune_nvals[k]]);
+			idx /= tune_nvals[k];
+		}
+		if (mm_set_config(&t->config) < 0)
+			continue;
+
+		/* Check, measure and time every trace under the policy */
+		secs = 0;
+		ops = 0;
+		t->valid = 1;
+		for (i = 0; t->valid && i < num_tracefiles; i++) {
+			if (!(t->valid = eval_mm_valid(traces[i], i, &ranges)))
+				break;
+			t->util += eval_mm_util(traces[i], i, &ranges);
+			speed_params.trace = traces[i];
+			speed_params.ranges = ranges;
+			time_speed(eval_mm_speed, &speed_params, &stats);
+			secs += stats.secs;
+			ops += traces[i]->num_ops;
+		}
+		t->util /= num_tracefiles;
+		t->thru = (secs > 0) ? ops / secs : 0;
+		if (verbose)
+			printf("%5d/%d: threshold %d classes %d chunk %zu "
+			       "split %zu side %d addr %d: %s\n",
+			    j + 1, ntune, t->config.fit_threshold,
+			    t->config.num_classes, t->config.chunksize,
+			    t->config.split_min, t->config.side_index,
+			    t->config.addr_order, t->valid ? "ok" : "invalid");
+	}
+	mm_set_config(&base);
+	clear_ranges(&ranges);
+
+	/* A policy is on the front if no other one is at least as good */
+	nfront = 0;
+	for (j = 0; j < ntune; j++) {
+		t = &tune[j];
+		t->front = t->valid;
+		for (k = 0; t->front && k < ntune; k++) {
+			u = &tune[k];
+			if (u->valid && u->thru >= t->thru &&
+			    u->util >= t->util &&
+			    (u->thru > t->thru || u->util > t->util))
+				t->front = 0;
+		}
+		nfront += t->front;
+	}
+	qsort(tune, ntune, sizeof(tune_t), cmp_tune);
+
+	printf("\nPolicies by throughput (* on the Pareto front):\n");
+	printf("  %9s%8s%9s%7s%6s%6s%8s%10s%7s\n", "threshold", "classes",
+	    "chunk", "split", "side", "addr", "util", "Kops", "index");
+	for (j = 0; j < ntune; j++) {
+		t = &tune[j];
+		printf("%c %9d%8d%9zu%7zu%6d%6d", t->front ? '*' : ' ',
+		    t->config.fit_threshold, t->config.num_classes,
+		    t->config.chunksize, t->config.split_min,
+		    t->config.side_index, t->config.addr_order);
+		if (!t->valid) {
+			printf("%25s\n", "invalid");
+			continue;
+		}
+		p2 = (t->thru < AVG_LIBC_THRUPUT) ? t->thru / AVG_LIBC_THRUPUT : 1;
+		printf("%7.1f%%%10.0f%7.0f\n", t->util * 100, t->thru / 1e3,
+		    (UTIL_WEIGHT * t->util + (1.0 - UTIL_WEIGHT) * p2) * 100);
+	}
+	printf("%d of %d policies are on the front.  Select one with "
+	       "MM_FIT_THRESHOLD,\nMM_NUM_CLASSES, MM_CHUNKSIZE, MM_SPLIT_MIN, "
+	       "MM_SIDE_INDEX and MM_ADDR_ORDER.\n",
+	    nfront, ntune);
+
+	for (i = 0; i < num_tracefiles; i++)
+		free_trace(traces[i]);
+	free(traces);
+	free(tune);
+}
+
+/*
+ * set_knob - Set the policy knob with index knob in tune_names to val
+ */
+static void
+set_knob(mm_config_t *config, int knob, long val)
+{
+	switch (knob) {
+	case 0:
+		config->fit_threshold = val;
+		break;
+	case 1:
+		config->num_classes = val;
+		break;
+	case 2:
+		config->chunksize = val;
+		break;
+	case 3:
+		config->split_min = val;
+		break;
+	case 4:
+		config->side_index = val;
+		break;
+	default:
+		config->addr_order = val;
+	}
+}
+
+/*
+ * cmp_tune - Order the auto-tuner's policies by decreasing throughput,
+ *     with the invalid ones last
+ */
+static int
+cmp_tune(const void *a, const void *b)
+{
+	const tune_t *t = a, *u = b;
+
+	if (t->valid != u->valid)
+		return u->valid - t->valid;
+	return (t->thru < u->thru) - (t->thru > u->thru);
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * printengines - prints the results of several engines side by side,
+ *     with the performance index that each would get
+ */
+static void
+printengines(int num_tracefiles, const engine_t **sel, int nsel,
+    stats_t *stats)
+{
+	stats_t *st;
+	double secs, ops, util, p2, index[MAXENGINES];
+	int i, e, valid;
+
+	printf("\nResults by engine:\n");
+	printf("%5s", "");
+	for (e = 0; e < nsel; e++)
+		printf("%s%-20.20s", e ? "    " : "  ", sel[e]->name);
+	printf("\n%5s", "trace");
+	for (e = 0; e < nsel; e++)
+		printf("%s%5s%6s%9s", e ? "    " : "  ", "valid", "util",
+		    "Kops");
+	printf("\n");
+
+	for (i = 0; i < num_tracefiles; i++) {
+		printf("%5d", i);
+		for (e = 0; e < nsel; e++) {
+			st = &stats[e * num_tracefiles + i];
+			printf("%s%5s", e ? "    " : "  ",
+			    st->valid ? "yes" : "no");
+			if (!st->valid)
+				printf("%15s", "");
+			else if (sel[e]->checked)
+				printf("%5.0f%%%9.0f", st->util * 100.0,
+				    st->ops / st->secs / 1e3);
+			else
+				printf("%6s%9.0f", "-", st->ops / st->secs / 1e3);
+		}
+		printf("\n");
+	}
+
+	/* The totals and the performance index, as main computes them */
+	printf("%5s", "Total");
+	for (e = 0; e < nsel; e++) {
+		secs = ops = util = 0;
+		valid = 1;
+		for (i = 0; i < num_tracefiles; i++) {
+			st = &stats[e * num_tracefiles + i];
+			valid &= st->valid;
+			secs += st->secs;
+			ops += st->ops;
+			util += st->util;
+		}
+		util /= num_tracefiles;
+		p2 = (ops / secs < AVG_LIBC_THRUPUT) ?
+		    ops / secs / AVG_LIBC_THRUPUT :
+		    1.0;
+		index[e] = (!valid || !sel[e]->checked) ? -1 :
+		    (UTIL_WEIGHT * util + (1.0 - UTIL_WEIGHT) * p2) * 100;
+		printf("%s%5s", e ? "    " : "  ", valid ? "" : "no");
+		if (!valid)
+			printf("%15s", "");
+		else if (sel[e]->checked)
+			printf("%5.0f%%%9.0f", util * 100.0, ops / secs / 1e3);
+		else
+			printf("%6s%9.0f", "-", ops / secs / 1e3);
+	}
+	printf("\n");
+
+	/* Only the valid engines that allocate from memlib's heap score */
+	for (valid = 0, e = 0; e < nsel; e++) {
+		if (index[e] < 0)
+			continue;
+		printf("%s %s %.0f/100", valid++ ? "," : "Perf index:",
+		    sel[e]->name, index[e]);
+	}
+	if (valid)
+		printf("\n");
+}
+
+/*
+ * printresults - prints a performance summary for some malloc package.
+ *     The utilization of a package that is not checked (see engine.h) was
+ *     never measured, so it prints as "-".
+ */
+static void
+printresults(int n, stats_t *stats, int checked)
+{
+	int i, k;
+	double secs = 0;
+	double ops = 0;
+	double timed_ops = 0; /* ops of the traces that were timed */
+	double util = 0;
+	double events[PERFCTR_NEVENTS] = { 0 };
+
+	/* Print the individual results for each trace, followed by the
+	 * hardware events per op when they are counted (-P) */
+	/* All the space before the last number on each line is added by
+	 * Zheng Cai, for better formatting */
+	printf("%5s%7s %5s%8s%10s %6s", "trace", " valid", "util", "ops",
+	    "secs", "Kops");
+	for (k = 0; use_counters && k < PERFCTR_NEVENTS; k++)
+		printf(" %7s", perfctr_names[k]);
+	printf("\n");
+	for (i = 0; i < n; i++) {
+		if (stats[i].valid && stats[i].secs == 0) {
+			/* A piped trace (-s) has no time measurement */
+			printf("%2d%10s", i, "yes");
+			printutil(checked, stats[i].util);
+			printf("%8.0f%10s %6s", stats[i].ops, "-", "-");
+			ops += stats[i].ops;
+			util += stats[i].util;
+			printevents(NULL, 0);
+		} else if (stats[i].valid) {
+			printf("%2d%10s", i, "yes");
+			printutil(checked, stats[i].util);
+			printf("%8.0f%10.6f %6.0f", stats[i].ops, stats[i].secs,
+			    (stats[i].ops / 1e3) / stats[i].secs);
+			secs += stats[i].secs;
+			ops += stats[i].ops;
+			timed_ops += stats[i].ops;
+			util += stats[i].util;
+			for (k = 0; k < PERFCTR_NEVENTS; k++)
+				events[k] = (stats[i].events[k] < 0 ||
+						events[k] < 0) ?
+				    -1 :
+				    events[k] + stats[i].events[k];
+			printevents(stats[i].events, stats[i].ops);
+		} else {
+			printf("%2d%10s%6s%8s%10s %6s", i, "no", "-", "-",
+			    "-", "-");
+			printevents(NULL, 0);
+		}
+	}
+
+	/* Print the aggregate results for the set of traces */
+	if (errors == 0 && secs == 0) {
+		printf("%12s", "Total       ");
+		printutil(checked, util / n);
+		printf("%8.0f%10s %6s", ops, "-", "-");
+		printevents(NULL, 0);
+	} else if (errors == 0) {
+		printf("%12s", "Total       ");
+		printutil(checked, util / n);
+		printf("%8.0f%10.6f %6.0f", ops, secs,
+		    (timed_ops / 1e3) / secs);
+		printevents(events, timed_ops);
+	} else {
+		printf("%12s%6s%8s%10s %6s", "Total       ", "-", "-", "-",
+		    "-");
+		printevents(NULL, 0);
+	}
+}
+
+/*
+ * printutil - prints the util column of printresults
+ */
+static void
+printutil(int checked, double util)
+{
+	if (checked)
+		printf("%5.0f%%", util * 100.0);
+	else
+		printf("%6s", "-");
+}
+
+/*
+ * printmemory - prints the size of the heap at the end of each trace's
+ *     checks, the memory committed to it, and how much of that the trace
+ *     touched
+ */
+static void
+printmemory(int n, stats_t *stats)
+{
+	int i;
+
+	printf("Memory of mm malloc (KB):\n");
+	printf("%5s%10s%11s%10s%9s%10s\n", "trace", "heap", "committed",
+	    "resident", "touched", "huge");
+	for (i = 0; i < n; i++) {
+		if (stats[i].committed == 0) {
+			printf("%2d%13s%11s%10s%9s%10s\n", i, "-", "-", "-", "-",
+			    "-");
+			continue;
+		}
+		printf("%2d%13.0f%11.0f%10.0f%8.0f%%%10.0f\n", i,
+		    stats[i].heap / 1024, stats[i].committed / 1024,
+		    stats[i].resident / 1024,
+		    100.0 * stats[i].resident / stats[i].committed,
+		    stats[i].huge / 1024);
+	}
+}
+
+/*
+ * printevents - ends a row of printresults with the hardware event
+ *     counts per op (-P), if there are any.  A NULL "events" or a
+ *     negative count, meaning that the event is unavailable, prints "-".
+ */
+static void
+printevents(const double *events, double ops)
+{
+	int k;
+
+	for (k = 0; use_counters && k < PERFCTR_NEVENTS; k++) {
+		if (events == NULL || events[k] < 0)
+			printf(" %7s", "-");
+		else
+			printf(" %7.2f", events[k] / ops);
+	}
+	printf("\n");
+}
+
+/*
+ * printlibc - Print the throughput of the mm malloc package on each trace
+ *     relative to that of the libc malloc package (-l)
+ */
+static void
+printlibc(int n, stats_t *stats)
+{
+	double secs = 0, libc_secs = 0, ops = 0, libc_ops = 0;
+	int i;
+
+	printf("Speed of mm malloc relative to libc malloc:\n");
+	printf("%5s%12s%12s%8s\n", "trace", "Kops", "libc Kops", "ratio");
+	for (i = 0; i < n; i++) {
+		if (!stats[i].valid || stats[i].secs == 0 ||
+		    libc_stats[i].secs == 0) {
+			printf("%2d%15s%12s%8s\n", i, "-", "-", "-");
+			continue;
+		}
+		printf("%2d%15.0f%12.0f%7.2fx\n", i,
+		    stats[i].ops / 1e3 / stats[i].secs,
+		    libc_stats[i].ops / 1e3 / libc_stats[i].secs,
+		    libc_stats[i].secs / stats[i].secs);
+		secs += stats[i].secs;
+		ops += stats[i].ops;
+		libc_secs += libc_stats[i].secs;
+		libc_ops += libc_stats[i].ops;
+	}
+	if (secs > 0)
+		printf("%5s%12.0f%12.0f%7.2fx\n", "Total", ops / 1e3 / secs,
+		    libc_ops / 1e3 / libc_secs,
+		    (ops / secs) / (libc_ops / libc_secs));
+	printf("\n");
+}
+
+/*
+ * parse_snapshots - Parse the argument of -S: a comma-separated list of
+ *     request numbers, and "peak"
+ */
+static void
+parse_snapshots(char *list)
+{
+	char *item, *end;
+	uint64_t op;
+	int i;
+
+	for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+		if (!strcmp(item, "peak")) {
+			snap_peak = 1;
+			continue;
+		}
+		op = strtoull(item, &end, 10);
+		if (op == 0 || *end != '\0' || num_snaps == MAXSNAPS) {
+			usage();
+			exit(1);
+		}
+
+		/* Keep the list sorted */
+		for (i = num_snaps++; i > 0 && snap_ops[i - 1] > op; i--)
+			snap_ops[i] = snap_ops[i - 1];
+		snap_ops[i] = op;
+	}
+}
+
+/*
+ * parse_size - Parse a size in bytes with an optional k, m or g suffix.
+ *     Returns 0 if it is not one.
+ */
+static size_t
+parse_size(const char *arg)
+{
+	static const char suffixes[] = "kmg";
+	const char *sfx;
+	char *end;
+	size_t size;
+
+	size = strtoull(arg, &end, 10);
+	if (*end != '\0' && (sfx = strchr(suffixes, tolower(*end))) != NULL) {
+		size <<= 10 * (sfx - suffixes + 1);
+		end++;
+	}
+	return (*end == '\0') ? size : 0;
+}
+
+/*
+ * parse_tune - Parse the argument of -T: a knob name, "=", and a
+ *     comma-separated list of the values to sweep it over
+ */
+static void
+parse_tune(char *arg)
+{
+	char *item, *end, *eq;
+	long val;
+	int k;
+
+	if ((eq = strchr(arg, '=')) == NULL) {
+		usage();
+		exit(1);
+	}
+	*eq = '\0';
+	for (k = 0; k < TUNE_KNOBS && strcmp(arg, tune_names[k]); k++)
+		;
+	if (k == TUNE_KNOBS || tune_nvals[k] > 0) {
+		usage();
+		exit(1);
+	}
+	for (item = strtok(eq + 1, ","); item != NULL;
+	     item = strtok(NULL, ",")) {
+		val = strtol(item, &end, 0);
+		if (*end != '\0' || (val < 0 && k != 0) ||
+		    tune_nvals[k] == MAXTUNE) {
+			usage();
+			exit(1);
+		}
+		tune_vals[k][tune_nvals[k]++] = val;
+	}
+	if (tune_nvals[k] == 0) {
+		usage();
+		exit(1);
+	}
+	tuning = 1;
+}
+
+/*
+ * parse_engines - Parse the argument of -e: a comma-separated list of
+ *     engine names, or "all".  Stores the engines in sel and returns how
+ *     many there are.
+ */
+static int
+parse_engines(char *list, const engine_t **sel)
+{
+	char *item;
+	int i, n = 0;
+
+	for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+		if (!strcmp(item, "all")) {
+			for (i = 0; engines[i] != NULL && n < MAXENGINES; i++)
+				sel[n++] = engines[i];
+			continue;
+		}
+		if (n == MAXENGINES || (sel[n] = find_engine(item)) == NULL) {
+			fprintf(stderr, "Unknown engine %s.  The engines are:\n",
+			    item);
+			for (i = 0; engines[i] != NULL; i++)
+				fprintf(stderr, "\t%-10s %s\n", engines[i]->name,
+				    engines[i]->desc);
+			exit(1);
+		}
+		n++;
+	}
+	if (n == 0) {
+		usage();
+		exit(1);
+	}
+	return n;
+}
+
+/*
+ * printlatency - prints the latency percentiles of each kind of request,
+ *     for each valid trace and for the whole run, in nanoseconds
+ */
+static void
+printlatency(int n, stats_t *stats)
+{
+	static const char *names[3] = { "malloc", "free", "realloc" };
+	static const double pcts[4] = { 50, 90, 99, 99.9 };
+	static lathist_t totals[3];
+	double ns = 1e3 / mhz(0);
+	lathist_t *h;
+	int i, type, k;
+
+	printf("Latency of mm malloc (ns):\n");
+	printf("%5s %-8s%10s%8s%8s%8s%8s%10s\n", "trace", "op", "count",
+	    "p50", "p90", "p99", "p99.9", "max");
+	for (i = 0; i <= n; i++) {
+		if (i < n && !stats[i].valid)
+			continue;
+		for (type = 0; type < 3; type++) {
+			h = (i < n) ? &lat_hists[i][type] : &totals[type];
+			if (i < n)
+				lathist_merge(&totals[type], h);
+			if (h->count == 0)
+				continue;
+			if (i < n)
+				printf("%5d ", i);
+			else
+				printf("%5s ", "Total");
+			printf("%-8s%10" PRIu64, names[type], h->count);
+			for (k = 0; k < 4; k++)
+				printf("%8.0f",
+				    lathist_percentile(h, pcts[k]) * ns);
+			printf("%10.0f\n", h->max * ns);
+		}
+	}
+	printf("\n");
+}
+
+/*
+ * printbench - Print the statistics of the benchmark runner (-B) for
+ *     each trace that it timed: the median and the MAD of the running
+ *     time of one replay, the 95% confidence interval of the median and
+ *     its half-width relative to the median.
+ */
+static void
+printbench(int n, stats_t *stats)
+{
+	bench_t *b;
+	double rel;
+	int i, unconverged = 0;
+
+	printf("Benchmark of mm malloc (us per replay):\n");
+	printf("%5s%8s%11s%10s%11s%11s%8s\n", "trace", "runs", "median",
+	    "MAD", "CI low", "CI high", "+/-");
+	for (i = 0; i < n; i++) {
+		b = &stats[i].bench;
+		if (!stats[i].valid || b->samples == 0)
+			continue;
+		rel = (b->hi - b->median > b->median - b->lo) ?
+		    b->hi - b->median :
+		    b->median - b->lo;
+		rel = 100 * rel / b->median;
+		printf("%5d%8d%11.2f%10.2f%11.2f%11.2f%7.2f%%%s\n", i,
+		    b->samples, b->median * 1e6, b->mad * 1e6, b->lo * 1e6,
+		    b->hi * 1e6, rel, b->converged ? "" : " *");
+		unconverged += !b->converged;
+	}
+	if (unconverged)
+		printf("* did not reach the target within the sample or time limit\n");
+	printf("\n");
+}
+
+/*
+ * trace_fields - Collect the metrics of trace tracenum that are written
+ *     by -o, other than its name and validity: the results table, then
+ *     the benchmark runner's statistics (-B), the latency percentiles
+ *     (-p), the libc malloc package's time (-l), and the hardware events
+ *     per op (-P), if they were measured.
+ *     Metrics that are undefined for the trace are NAN.  Returns the
+ *     number of metrics.
+ */
+static int
+trace_fields(stats_t *stats, int tracenum, char names[][32], double *values)
+{
+	static const char *ops[3] = { "malloc", "free", "realloc" };
+	static const char *pcts[4] = { "p50", "p90", "p99", "p999" };
+	static const double pctvals[4] = { 50, 90, 99, 99.9 };
+	stats_t *st = &stats[tracenum];
+	int timed = st->valid && st->secs > 0;
+	lathist_t *h;
+	int n = 0, type, k;
+
+#define FIELD(value, ...)                                             \
+	do {                                                          \
+		snprintf(names[n], sizeof(names[n]), __VA_ARGS__);    \
+		values[n++] = (value);                                \
+	} while (0)
+
+	FIELD(st->valid ? st->util : NAN, "util");
+	FIELD(st->ops, "ops");
+	FIELD(timed ? st->secs : NAN, "secs");
+	FIELD(timed ? st->ops / 1e3 / st->secs : NAN, "kops");
+	FIELD(st->committed > 0 ? st->heap : NAN, "heap");
+	FIELD(st->committed > 0 ? st->committed : NAN, "committed");
+	FIELD(st->committed > 0 ? st->resident : NAN, "resident");
+	FIELD(st->committed > 0 ? st->huge : NAN, "huge");
+	if (use_bench) {
+		timed = timed && st->bench.samples > 0;
+		FIELD(timed ? st->bench.samples : NAN, "runs");
+		FIELD(timed ? st->bench.median : NAN, "median");
+		FIELD(timed ? st->bench.mad : NAN, "mad");
+		FIELD(timed ? st->bench.lo : NAN, "ci_lo");
+		FIELD(timed ? st->bench.hi : NAN, "ci_hi");
+	}
+	for (type = 0; lat_hists != NULL && type < 3; type++) {
+		h = &lat_hists[tracenum][type];
+		FIELD(h->count, "%s_count", ops[type]);
+		for (k = 0; k < 4; k++)
+			FIELD(h->count ? lathist_percentile(h, pctvals[k]) *
+				    1e3 / mhz(0) :
+					 NAN,
+			    "%s_%s_ns", ops[type], pcts[k]);
+		FIELD(h->count ? h->max * 1e3 / mhz(0) : NAN,
+		    "%s_max_ns", ops[type]);
+	}
+	if (libc_stats != NULL) {
+		timed = st->valid && st->secs > 0 && libc_stats[tracenum].secs > 0;
+		FIELD(timed ? libc_stats[tracenum].secs : NAN, "libc_secs");
+		FIELD(timed ? st->ops / 1e3 / libc_stats[tracenum].secs : NAN,
+		    "libc_kops");
+		FIELD(timed ? libc_stats[tracenum].secs / st->secs : NAN,
+		    "vs_libc");
+	}
+	for (k = 0; use_counters && k < PERFCTR_NEVENTS; k++)
+		FIELD((st->valid && st->events[k] >= 0) ?
+			st->events[k] / st->ops :
+			NAN,
+		    "%s_per_op", perfctr_names[k]);
+#undef FIELD
+
+	return n;
+}
+
+/*
+ * writeresults - Write every metric of every trace to the file path, as
+ *     JSON if its name ends in ".json" and as CSV otherwise.  The CSV
+ *     file has a header line; undefined metrics are empty in CSV and
+ *     null in JSON.
+ */
+static void
+writeresults(char *path, char **tracefiles, int n, stats_t *stats)
+{
+	char names[MAXFIELDS][32];
+	double values[MAXFIELDS];
+	size_t len = strlen(path);
+	int json = len >= 5 && !strcmp(path + len - 5, ".json");
+	int i, k, nfields;
+	char *c;
+	FILE *fp;
+
+	if ((fp = fopen(path, "w")) == NULL)
+		unix_error("Could not open the results file");
+
+	if (json)
+		fprintf(fp, "{\n  \"traces\": [");
+	for (i = 0; i < n; i++) {
+		nfields = trace_fields(stats, i, names, values);
+		if (json) {
+			fprintf(fp, "%s\n    {\"trace\": \"", i ? "," : "");
+			for (c = tracefiles[i]; *c; c++)
+				fprintf(fp, (*c == '"' || *c == '\\') ?
+					"\\%c" :
+					"%c",
+				    *c);
+			fprintf(fp, "\", \"valid\": %s",
+			    stats[i].valid ? "true" : "false");
+			for (k = 0; k < nfields; k++) {
+				if (isnan(values[k]))
+					fprintf(fp, ", \"%s\": null", names[k]);
+				else
+					fprintf(fp, ", \"%s\": %.9g", names[k],
+					    values[k]);
+			}
+			fprintf(fp, "}");
+			continue;
+		}
+		if (i == 0) {
+			fprintf(fp, "trace,valid");
+			for (k = 0; k < nfields; k++)
+				fprintf(fp, ",%s", names[k]);
+			fprintf(fp, "\n");
+		}
+		/* Quote the name, which may contain commas or quotes. */
+		fputc('"', fp);
+		for (c = tracefiles[i]; *c; c++)
+			fprintf(fp, (*c == '"') ? "\"\"" : "%c", *c);
+		fprintf(fp, "\",%d", stats[i].valid);
+		for (k = 0; k < nfields; k++) {
+			if (isnan(values[k]))
+				fprintf(fp, ",");
+			else
+				fprintf(fp, ",%.9g", values[k]);
+		}
+		fprintf(fp, "\n");
+	}
+	if (json)
+		fprintf(fp, "\n  ],\n  \"errors\": %d\n}\n", errors);
+	if (fclose(fp) != 0)
+		unix_error("Could not write the results file");
+}
+
+/*
+ * csv_field - Like strsep(p, ","), but a field in double quotes may
+ *     contain commas and doubled quotes, and is returned unquoted.
+ */
+static char *
+csv_field(char **p)
+{
+	char *s = *p, *r, *w;
+
+	if (s == NULL || *s != '"')
+		return strsep(p, ",");
+	for (r = w = s + 1; *r != '\0'; r++) {
+		if (*r == '"' && *++r != '"')
+			break;
+		*w++ = *r;
+	}
+	*p = (*r == ',') ? r + 1 : NULL;
+	*w = '\0';
+	return s + 1;
+}
+
+/*
+ * read_baseline - Read the traces of a CSV results file written by -o.
+ *     Returns the number of traces, which are left in *base.
+ */
+static int
+read_baseline(char *path, baseline_t **base)
+{
+	char line[RESULTLINE];
+	char *p, *field;
+	int col[6] = { -1, -1, -1, -1, -1, -1 };
+	static const char *want[6] = { "trace", "valid", "util", "secs",
+		"ci_lo", "ci_hi" };
+	double v[6];
+	int n = 0, nalloc = 16, k, j;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		unix_error("Could not open the baseline file");
+
+	/* Find the columns we compare in the header */
+	if (fgets(line, sizeof(line), fp) == NULL)
+		app_error("The baseline file is empty");
+	line[strcspn(line, "\r\n")] = '\0';
+	for (p = line, k = 0; (field = csv_field(&p)); k++) {
+		for (j = 0; j < 6; j++)
+			if (!strcmp(field, want[j]))
+				col[j] = k;
+	}
+	if (col[0] < 0 || col[1] < 0 || col[2] < 0 || col[3] < 0)
+		app_error("The baseline file is not a CSV file written by -o");
+
+	if ((*base = malloc(nalloc * sizeof(baseline_t))) == NULL)
+		unix_error("malloc failed in read_baseline");
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (n == nalloc &&
+		    (*base = realloc(*base,
+			 (nalloc *= 2) * sizeof(baseline_t))) == NULL)
+			unix_error("realloc failed in read_baseline");
+		for (j = 0; j < 6; j++)
+			v[j] = NAN;
+		(*base)[n].name[0] = '\0';
+		for (p = line, k = 0; (field = csv_field(&p)); k++) {
+			for (j = 0; j < 6; j++) {
+				if (k != col[j])
+					continue;
+				if (j == 0)
+					snprintf((*base)[n].name, MAXLINE, "%s",
+					    field);
+				else if (*field != '\0')
+					v[j] = atof(field);
+			}
+		}
+		(*base)[n].valid = v[1] > 0;
+		(*base)[n].util = v[2];
+		(*base)[n].secs = v[3];
+		(*base)[n].lo = v[4];
+		(*base)[n].hi = v[5];
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+/*
+ * compare_baseline - Compare the results with those in the baseline file
+ *     and print a table of the differences.  A trace regresses if it was
+ *     valid and no longer is, if its utilization drops by more than
+ *     REGRESS_UTIL, or if it got significantly slower: if both runs have
+ *     confidence intervals (-B), when they do not overlap, and otherwise
+ *     when it is more than REGRESS_SLOWDOWN slower.  Traces are matched by
+ *     file name.  Returns the number of traces that regressed.
+ */
+static int
+compare_baseline(char *path, char **tracefiles, int n, stats_t *stats)
+{
+	baseline_t *base, *b;
+	int nbase, i, j, slower, lessutil, regressions = 0;
+	double lo;
+
+	nbase = read_baseline(path, &base);
+	printf("Comparison with %s:\n", path);
+	printf("%5s%10s%10s%8s%7s%7s  %s\n", "trace", "Kops", "base",
+	    "change", "util", "base", "result");
+	for (i = 0; i < n; i++) {
+		for (j = 0, b = NULL; j < nbase && b == NULL; j++)
+			if (!strcmp(base[j].name, tracefiles[i]))
+				b = &base[j];
+		printf("%5d", i);
+		if (b == NULL || !b->valid) {
+			printf("%49s\n", b == NULL ? "new" : "was invalid");
+			continue;
+		}
+		if (!stats[i].valid) {
+			printf("%49s\n", "REGRESSION (invalid)");
+			regressions++;
+			continue;
+		}
+
+		lessutil = stats[i].util < b->util - REGRESS_UTIL;
+		slower = 0;
+		if (stats[i].secs > 0 && b->secs > 0) {
+			lo = use_bench ? stats[i].bench.lo : NAN;
+			if (!isnan(lo) && !isnan(b->hi))
+				slower = lo > b->hi;
+			else
+				slower = stats[i].secs >
+				    b->secs * (1 + REGRESS_SLOWDOWN);
+			printf("%10.0f%10.0f%7.1f%%", stats[i].ops / 1e3 /
+				stats[i].secs,
+			    stats[i].ops / 1e3 / b->secs,
+			    100 * (b->secs / stats[i].secs - 1));
+		} else
+			printf("%10s%10s%8s", "-", "-", "-");
+		printf("%6.0f%%%6.0f%%  %s\n", stats[i].util * 100,
+		    b->util * 100,
+		    (slower && lessutil) ? "REGRESSION (thru, util)" :
+			slower		 ? "REGRESSION (thru)" :
+			lessutil	 ? "REGRESSION (util)" :
+					   "ok");
+		regressions += slower || lessutil;
+	}
+	printf("%d of %d traces regressed\n\n", regressions, n);
+	free(base);
+	return regressions;
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+void
+app_error(char *msg)
+{
+	printf("%s\n", msg);
+	exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+void
+unix_error(char *msg)
+{
+	printf("%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+/*
+ * malloc_error - Report an error returned by the mm_malloc package
+ */
+void
+malloc_error(int tracenum, uint64_t opnum, char *msg)
+{
+	errors++;
+	printf("ERROR [trace %d, line %" PRIu64 "]: %s\n", tracenum,
+	    LINENUM(opnum), msg);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: mdriver [-aghlLpPsvV] [-b <file>] [-B <pct>] [-c <k>] [-e <list>]\n"
+	    "               [-f <file>] [-F <n>[:<file>]] [-H <pages>] [-j <n>] [-m <mode>]\n"
+	    "               [-M <size>] [-o <file>] [-S <list>] [-t <dir>]\n"
+	    "               [-T <knob>=<list>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-a         Don't check the team structure.\n");
+	fprintf(stderr,
+	    "\t-b <file>  Compare with a CSV file from -o; exit 1 on a regression.\n"
+	    "\t           Without -B, any slowdown over a fixed 5%% is a regression,\n"
+	    "\t           however noisy the timings are.\n");
+	fprintf(stderr,
+	    "\t-B <pct>   Time each trace to a 95%% CI of +/- <pct>%% of the median.\n");
+	fprintf(stderr,
+	    "\t-c <k>     Run mm_checkheap after every <k> requests of the checks.\n");
+	fprintf(stderr,
+	    "\t-e <list>  Replay through these engines (\"mm,implicit,libc\", \"all\").\n");
+	fprintf(stderr,
+	    "\t-f <file>  Use <file> (text or rep2bin output) as the trace file.\n");
+	fprintf(stderr,
+	    "\t-F <n>[:<file>] Profile fragmentation every <n> requests (frag.csv).\n");
+	fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr,
+	    "\t-H thp     Back the heap with transparent huge pages.\n");
+	fprintf(stderr,
+	    "\t-H hugetlb Back the heap with explicit huge pages (MAP_HUGETLB).\n");
+	fprintf(stderr,
+	    "\t-j <n>     Check up to <n> traces at once; time them serially.\n");
+	fprintf(stderr,
+	    "\t-m shard   Also time each trace sharded by id over 1..ncpu threads.\n");
+	fprintf(stderr,
+	    "\t-m trace   Also time one trace per thread over 1..ncpu threads.\n");
+	fprintf(stderr,
+	    "\t-l         Also time libc malloc; print mm's speed relative to it.\n");
+	fprintf(stderr,
+	    "\t-L         Like -l, and cap the throughput score at libc's rate.\n");
+	fprintf(stderr,
+	    "\t-M <size>  Let the heap grow to <size> bytes (k, m, g suffixes).\n");
+	fprintf(stderr,
+	    "\t-o <file>  Write all per-trace metrics as CSV (or JSON if *.json).\n");
+	fprintf(stderr,
+	    "\t-p         Print malloc/free/realloc latency percentiles.\n");
+	fprintf(stderr,
+	    "\t-P         Print hardware event counts per op (perf_event_open).\n");
+	fprintf(stderr,
+	    "\t-s         Stream the traces in chunks (\"-f -\" reads stdin).\n");
+	fprintf(stderr,
+	    "\t-S <list>  Write heap snapshots after these requests (\"1000,peak\").\n");
+	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	fprintf(stderr,
+	    "\t-T <knob>=<list> Sweep a policy knob (threshold, classes, chunk,\n"
+	    "\t           split, side, addr) and print the throughput/util\n"
+	    "\t           Pareto front.\n");
 	fprintf(stderr,
 	    "\t-v         Print per-trace performance breakdowns.\n");
 	fprintf(stderr, "\t-V         Print additional debug info.\n");
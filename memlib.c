@@ -2,11 +2,36 @@
  * memlib.c - a module that simulates the memory system.  Needed because it
  *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
+ *
+ * Each heap is a reservation of address space that has no memory behind
+ * it (PROT_NONE), so it can be as large as the address space allows.  As
+ * the break advances, the pages below it are committed (made accessible)
+ * in steps of at least COMMIT_STEP bytes.  Resetting the break keeps them
+ * committed, so that replaying a trace again does not page fault again;
+ * mem_release returns them to the system.
+ *
+ * With mem_set_pages, the heap can instead be backed by huge pages, to
+ * cut the TLB misses of walks over a large heap.  The reservation is then
+ * aligned to a huge page and committed a huge page at a time, so that the
+ * kernel can back it entirely with transparent huge pages (MADV_HUGEPAGE)
+ * or with pages from the hugetlbfs pool (MAP_HUGETLB).
+ *
+ * Besides the break, an allocator can map segments anywhere in the address
+ * space with mem_map, as it would with mmap, when the break cannot grow,
+ * grow or shrink them with mem_remap, which moves a segment as mremap
+ * does instead of copying it, and unmap them with mem_unmap.  Together they can hold as many bytes as
+ * the reservation.  mem_heap_lo and mem_heap_hi then bound the mappings as
+ * well as the break, and mem_heapsize reports the most bytes that the
+ * break and the mappings have held at once, so that unmapping a segment
+ * cannot improve an allocator's utilization.
  */
+#define _GNU_SOURCE /* for mremap() */
+
 #include <sys/mman.h>
 
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,72 +40,643 @@
 #include "config.h"
 #include "memlib.h"
 
+/* The least number of bytes that are committed at a time */
+#define COMMIT_STEP (64 * 1024)
+
+/* The size of a huge page, which huge-page heaps commit at a time */
+#define HUGE_PAGE (2 * 1024 * 1024)
+
+/* A segment mapped by mem_map */
+struct mem_seg {
+	char *addr;
+	size_t len;
+	struct mem_seg *next;
+};
+
+/* One simulated heap */
+struct mem_ctx {
+	char *mem_start_brk; /* points to first byte of heap */
+	char *mem_brk;	     /* points to last byte of heap */
+	char *mem_max_addr;  /* largest legal heap address */
+	char *mem_commit;    /* end of the committed pages */
+	int pages;	     /* MEM_PAGES_* */
+	size_t step;	     /* bytes committed at a time */
+	struct mem_seg *segs; /* the segments mapped by mem_map */
+	size_t mapped;	     /* bytes in those segments */
+	size_t peak;	     /* most bytes in the break and segments */
+	char *lo, *hi;	     /* bounds of the break and segments */
+};
+
 /* private variables */
-static char *mem_start_brk; /* points to first byte of heap */
-static char *mem_brk;	    /* points to last byte of heap */
-static char *mem_max_addr;  /* largest legal heap address */
+static size_t max_heap_size = MAX_HEAP; /* size of mem_init's heap */
+static int page_mode = MEM_PAGES_BASE;	/* pages of the heaps created */
+static mem_ctx_t *default_ctx;	    /* the heap that mem_init creates */
+static __thread mem_ctx_t *cur_ctx; /* this thread's heap, if not that one */
+
+/* The context that the original functions operate on */
+#define CUR_CTX() ((cur_ctx != NULL) ? cur_ctx : default_ctx)
 
 /*
- * mem_init - initialize the memory system model
+ * reserve - map len bytes of inaccessible address space for ctx, at addr
+ *    if it is not NULL, to be backed by the kind of pages that ctx uses.
+ *    Returns NULL if it cannot.
  */
-void
-mem_init(void)
+static char *
+reserve(mem_ctx_t *ctx, char *addr, size_t len)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	void *p;
+
+	if (addr != NULL)
+		flags |= MAP_FIXED;
+#ifdef MAP_HUGETLB
+	/* Without the reservation, touching a page could raise SIGBUS */
+	if (ctx->pages == MEM_PAGES_HUGETLB)
+		flags = (flags & ~MAP_NORESERVE) | MAP_HUGETLB;
+#endif
+	if ((p = mmap(addr, len, PROT_NONE, flags, -1, 0)) == MAP_FAILED)
+		return NULL;
+#ifdef MADV_HUGEPAGE
+	if (ctx->pages == MEM_PAGES_THP && madvise(p, len, MADV_HUGEPAGE) < 0 &&
+	    addr == NULL)
+		fprintf(stderr, "mem_create: no transparent huge pages: %s\n",
+		    strerror(errno));
+#endif
+	return p;
+}
+
+/*
+ * unmap_all - unmap every segment of ctx, leaving only its break
+ */
+static void
+unmap_all(mem_ctx_t *ctx)
+{
+	struct mem_seg *seg;
+
+	while ((seg = ctx->segs) != NULL) {
+		ctx->segs = seg->next;
+		munmap(seg->addr, seg->len);
+		free(seg);
+	}
+	ctx->mapped = 0;
+	ctx->peak = ctx->mem_brk - ctx->mem_start_brk;
+	ctx->lo = ctx->mem_start_brk;
+	ctx->hi = ctx->mem_brk;
+}
+
+/*
+ * mem_create - create a simulated heap that can grow to max_heap bytes
+ */
+mem_ctx_t *
+mem_create(size_t max_heap)
 {
-	/* allocate the storage we will use to model the available VM */
-	if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-		fprintf(stderr, "mem_init_vm: malloc error\n");
+	mem_ctx_t *ctx;
+	size_t align = mem_pagesize(), lead;
+	char *p = NULL;
+
+	if ((ctx = malloc(sizeof(mem_ctx_t))) == NULL) {
+		fprintf(stderr, "mem_create: malloc error\n");
 		exit(1);
 	}
+	ctx->pages = page_mode;
+	ctx->step = COMMIT_STEP;
+	if (ctx->pages != MEM_PAGES_BASE) {
+		align = HUGE_PAGE;
+		ctx->step = HUGE_PAGE;
+	}
 
-	mem_max_addr = mem_start_brk + MAX_HEAP; /* max legal heap address */
-	mem_brk = mem_start_brk;		 /* heap is empty initially */
+	/* reserve the address space we will use to model the available VM */
+	max_heap = (max_heap + align - 1) / align * align;
+	if (ctx->pages == MEM_PAGES_HUGETLB &&
+	    (p = reserve(ctx, NULL, max_heap)) == NULL) {
+		fprintf(stderr,
+		    "mem_create: no %zu bytes of explicit huge pages (%s); "
+		    "using transparent ones\n",
+		    max_heap, strerror(errno));
+		ctx->pages = MEM_PAGES_THP;
+	}
+	if (ctx->pages == MEM_PAGES_THP) {
+		/* Reserve a huge page more, and trim the ends to align it */
+		if ((p = reserve(ctx, NULL, max_heap + HUGE_PAGE)) != NULL) {
+			lead = (HUGE_PAGE - (uintptr_t)p % HUGE_PAGE) %
+			    HUGE_PAGE;
+			if (lead > 0)
+				munmap(p, lead);
+			munmap(p + lead + max_heap, HUGE_PAGE - lead);
+			p += lead;
+		}
+	} else if (ctx->pages == MEM_PAGES_BASE)
+		p = reserve(ctx, NULL, max_heap);
+	if (p == NULL) {
+		fprintf(stderr, "mem_create: could not reserve %zu bytes: %s\n",
+		    max_heap, strerror(errno));
+		exit(1);
+	}
+
+	ctx->mem_start_brk = p;
+	ctx->mem_max_addr = ctx->mem_start_brk + max_heap; /* max legal addr */
+	ctx->mem_brk = ctx->mem_start_brk; /* heap is empty initially */
+	ctx->mem_commit = ctx->mem_start_brk; /* nothing is committed yet */
+	ctx->segs = NULL;
+	ctx->mapped = ctx->peak = 0;
+	ctx->lo = ctx->hi = ctx->mem_start_brk;
+	return ctx;
 }
 
 /*
- * mem_deinit - free the storage used by the memory system model
+ * mem_destroy - free the storage used by a simulated heap
  */
 void
-mem_deinit(void)
+mem_destroy(mem_ctx_t *ctx)
 {
-	free(mem_start_brk);
+	if (cur_ctx == ctx)
+		cur_ctx = NULL;
+	if (default_ctx == ctx)
+		default_ctx = NULL;
+	unmap_all(ctx);
+	munmap(ctx->mem_start_brk, ctx->mem_max_addr - ctx->mem_start_brk);
+	free(ctx);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_set_ctx - make ctx the calling thread's heap, or with NULL, make
+ *    mem_init's heap its heap again.  Returns the previous context.
+ */
+mem_ctx_t *
+mem_set_ctx(mem_ctx_t *ctx)
+{
+	mem_ctx_t *old = CUR_CTX();
+
+	cur_ctx = ctx;
+	return old;
+}
+
+/*
+ * mem_get_ctx - return the calling thread's heap
+ */
+mem_ctx_t *
+mem_get_ctx(void)
+{
+	return CUR_CTX();
+}
+
+/*
+ * mem_ctx_reset_brk - reset the simulated brk pointer to make an empty heap
  */
 void
-mem_reset_brk()
+mem_ctx_reset_brk(mem_ctx_t *ctx)
 {
-	mem_brk = mem_start_brk;
+	ctx->mem_brk = ctx->mem_start_brk;
+	unmap_all(ctx);
 }
 
 /*
- * mem_sbrk - simple model of the sbrk function. Extends the heap
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ * mem_ctx_release - empty the heap and return its pages to the system
+ */
+void
+mem_ctx_release(mem_ctx_t *ctx)
+{
+	size_t len = ctx->mem_commit - ctx->mem_start_brk;
+
+	/* Map a fresh reservation over the committed pages */
+	if (len > 0 && reserve(ctx, ctx->mem_start_brk, len) == NULL) {
+		fprintf(stderr, "mem_release: mmap error: %s\n",
+		    strerror(errno));
+		exit(1);
+	}
+	ctx->mem_brk = ctx->mem_commit = ctx->mem_start_brk;
+	unmap_all(ctx);
+}
+
+/*
+ * mem_ctx_sbrk - simple model of the sbrk function. Extends the heap
+ *    by incr bytes, committing any pages that it needs, and returns the
+ *    start address of the new area. In this model, the heap cannot be
+ *    shrunk.
  */
 void *
-mem_sbrk(intptr_t incr)
+mem_ctx_sbrk(mem_ctx_t *ctx, intptr_t incr)
 {
-	char *old_brk = mem_brk;
+	char *old_brk = ctx->mem_brk;
+	size_t grow;
 
-	if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+	if ((incr < 0) || (incr > ctx->mem_max_addr - ctx->mem_brk)) {
 		errno = ENOMEM;
 		fprintf(stderr,
 		    "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
-	mem_brk += incr;
+	if (ctx->mem_brk + incr > ctx->mem_commit) {
+		grow = ctx->mem_brk + incr - ctx->mem_commit;
+		grow = (grow + ctx->step - 1) / ctx->step * ctx->step;
+		if (grow > (size_t)(ctx->mem_max_addr - ctx->mem_commit))
+			grow = ctx->mem_max_addr - ctx->mem_commit;
+		if (mprotect(ctx->mem_commit, grow, PROT_READ | PROT_WRITE) <
+		    0) {
+			fprintf(stderr,
+			    "ERROR: mem_sbrk failed. Could not commit "
+			    "memory: %s\n", strerror(errno));
+			errno = ENOMEM;
+			return (void *)-1;
+		}
+		ctx->mem_commit += grow;
+	}
+	ctx->mem_brk += incr;
+	ctx->hi = (ctx->mem_brk > ctx->hi) ? ctx->mem_brk : ctx->hi;
+	if ((size_t)(ctx->mem_brk - ctx->mem_start_brk) + ctx->mapped >
+	    ctx->peak)
+		ctx->peak = ctx->mem_brk - ctx->mem_start_brk + ctx->mapped;
 	return (void *)old_brk;
 }
 
+/*
+ * mem_ctx_sbrk_avail - returns the most bytes that mem_ctx_sbrk can
+ *    still extend the heap by
+ */
+size_t
+mem_ctx_sbrk_avail(mem_ctx_t *ctx)
+{
+	return ctx->mem_max_addr - ctx->mem_brk;
+}
+
+/*
+ * mem_ctx_map - simple model of an anonymous mmap.  Maps a segment of
+ *    len bytes, rounded up to the kind of pages that back the heap, apart
+ *    from the break, and returns its start address.
+ */
+void *
+mem_ctx_map(mem_ctx_t *ctx, size_t len)
+{
+	size_t align = (ctx->pages == MEM_PAGES_BASE) ? mem_pagesize() :
+							HUGE_PAGE;
+	struct mem_seg *seg;
+	char *p;
+
+	len = (len + align - 1) / align * align;
+	if (len == 0 || len > (size_t)(ctx->mem_max_addr -
+	    ctx->mem_start_brk) - ctx->mapped) {
+		errno = ENOMEM;
+		fprintf(stderr,
+		    "ERROR: mem_map failed. Ran out of memory...\n");
+		return (void *)-1;
+	}
+	if ((seg = malloc(sizeof(struct mem_seg))) == NULL) {
+		fprintf(stderr, "mem_map: malloc error\n");
+		exit(1);
+	}
+	if ((p = reserve(ctx, NULL, len)) == NULL ||
+	    mprotect(p, len, PROT_READ | PROT_WRITE) < 0) {
+		fprintf(stderr,
+		    "ERROR: mem_map failed. Could not map memory: %s\n",
+		    strerror(errno));
+		if (p != NULL)
+			munmap(p, len);
+		free(seg);
+		errno = ENOMEM;
+		return (void *)-1;
+	}
+	seg->addr = p;
+	seg->len = len;
+	seg->next = ctx->segs;
+	ctx->segs = seg;
+	ctx->mapped += len;
+	if ((size_t)(ctx->mem_brk - ctx->mem_start_brk) + ctx->mapped >
+	    ctx->peak)
+		ctx->peak = ctx->mem_brk - ctx->mem_start_brk + ctx->mapped;
+	ctx->lo = (p < ctx->lo) ? p : ctx->lo;
+	ctx->hi = (p + len > ctx->hi) ? p + len : ctx->hi;
+	return p;
+}
+
+/*
+ * mem_ctx_unmap - unmap the segment at addr that mem_ctx_map mapped with
+ *    len bytes.  Returns 0, or -1 if there is no such segment.
+ */
+int
+mem_ctx_unmap(mem_ctx_t *ctx, void *addr, size_t len)
+{
+	size_t align = (ctx->pages == MEM_PAGES_BASE) ? mem_pagesize() :
+							HUGE_PAGE;
+	struct mem_seg **segp, *seg;
+
+	len = (len + align - 1) / align * align;
+	for (segp = &ctx->segs; (seg = *segp) != NULL; segp = &seg->next) {
+		if (seg->addr != addr)
+			continue;
+		if (seg->len != len)
+			break;
+		*segp = seg->next;
+		munmap(seg->addr, seg->len);
+		ctx->mapped -= seg->len;
+		free(seg);
+		return 0;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * mem_ctx_remap - resize the segment at addr that mem_ctx_map mapped with
+ *    len bytes to newlen bytes, moving it if need be, as mremap does.  Only
+ *    the difference counts toward the heap's size.  Returns the segment's
+ *    new start address, or (void *)-1 if it cannot.
+ */
+void *
+mem_ctx_remap(mem_ctx_t *ctx, void *addr, size_t len, size_t newlen)
+{
+	size_t align = (ctx->pages == MEM_PAGES_BASE) ? mem_pagesize() :
+							HUGE_PAGE;
+	struct mem_seg *seg;
+	char *p;
+
+	len = (len + align - 1) / align * align;
+	newlen = (newlen + align - 1) / align * align;
+	for (seg = ctx->segs; seg != NULL; seg = seg->next)
+		if (seg->addr == addr)
+			break;
+	if (seg == NULL || seg->len != len || newlen == 0) {
+		errno = EINVAL;
+		return (void *)-1;
+	}
+	if (newlen > len && newlen - len > (size_t)(ctx->mem_max_addr -
+	    ctx->mem_start_brk) - ctx->mapped) {
+		errno = ENOMEM;
+		fprintf(stderr,
+		    "ERROR: mem_remap failed. Ran out of memory...\n");
+		return (void *)-1;
+	}
+	if ((p = mremap(addr, len, newlen, MREMAP_MAYMOVE)) == MAP_FAILED) {
+		fprintf(stderr,
+		    "ERROR: mem_remap failed. Could not map memory: %s\n",
+		    strerror(errno));
+		errno = ENOMEM;
+		return (void *)-1;
+	}
+	seg->addr = p;
+	seg->len = newlen;
+	ctx->mapped = ctx->mapped - len + newlen;
+	if ((size_t)(ctx->mem_brk - ctx->mem_start_brk) + ctx->mapped >
+	    ctx->peak)
+		ctx->peak = ctx->mem_brk - ctx->mem_start_brk + ctx->mapped;
+	ctx->lo = (p < ctx->lo) ? p : ctx->lo;
+	ctx->hi = (p + newlen > ctx->hi) ? p + newlen : ctx->hi;
+	return p;
+}
+
+/*
+ * mem_ctx_heap_lo - return address of the first heap byte
+ */
+void *
+mem_ctx_heap_lo(mem_ctx_t *ctx)
+{
+	return (void *)ctx->lo;
+}
+
+/*
+ * mem_ctx_heap_hi - return address of last heap byte
+ */
+void *
+mem_ctx_heap_hi(mem_ctx_t *ctx)
+{
+	return (void *)(ctx->hi - 1);
+}
+
+/*
+ * mem_ctx_region - return the start of the break or of the mapped segment
+ *    that holds addr, and its length in *len, or NULL if neither does
+ */
+void *
+mem_ctx_region(mem_ctx_t *ctx, void *addr, size_t *len)
+{
+	char *p = (char *)addr;
+	struct mem_seg *seg;
+
+	if (p >= ctx->mem_start_brk && p < ctx->mem_brk) {
+		*len = ctx->mem_brk - ctx->mem_start_brk;
+		return ctx->mem_start_brk;
+	}
+	for (seg = ctx->segs; seg != NULL; seg = seg->next) {
+		if (p >= seg->addr && p < seg->addr + seg->len) {
+			*len = seg->len;
+			return seg->addr;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * mem_ctx_heapsize() - returns the heap size in bytes, the most that the
+ *    break and the mapped segments have held at once
+ */
+size_t
+mem_ctx_heapsize(mem_ctx_t *ctx)
+{
+	return ctx->peak;
+}
+
+/*
+ * mem_ctx_committed() - returns the number of bytes committed to the heap
+ */
+size_t
+mem_ctx_committed(mem_ctx_t *ctx)
+{
+	return (size_t)(ctx->mem_commit - ctx->mem_start_brk) + ctx->mapped;
+}
+
+/*
+ * resident_bytes - returns the number of bytes of the len bytes of pages
+ *    at p that are resident in memory
+ */
+static size_t
+resident_bytes(char *p, size_t len)
+{
+	size_t pagesize = mem_pagesize();
+	size_t i, npages = len / pagesize, resident = 0;
+	unsigned char *vec;
+
+	if (npages == 0)
+		return 0;
+	if ((vec = malloc(npages)) == NULL) {
+		fprintf(stderr, "mem_resident: malloc error\n");
+		exit(1);
+	}
+	if (mincore(p, npages * pagesize, vec) < 0) {
+		fprintf(stderr, "mem_resident: mincore error: %s\n",
+		    strerror(errno));
+		exit(1);
+	}
+	for (i = 0; i < npages; i++)
+		resident += vec[i] & 1;
+	free(vec);
+	return resident * pagesize;
+}
+
+/*
+ * mem_ctx_resident() - returns the number of bytes of the committed pages
+ *    that are resident in memory, that is, that have been touched since
+ *    the heap was created or released and not been swapped out
+ */
+size_t
+mem_ctx_resident(mem_ctx_t *ctx)
+{
+	struct mem_seg *seg;
+	size_t resident;
+
+	resident = resident_bytes(ctx->mem_start_brk,
+	    ctx->mem_commit - ctx->mem_start_brk);
+	for (seg = ctx->segs; seg != NULL; seg = seg->next)
+		resident += resident_bytes(seg->addr, seg->len);
+	return resident;
+}
+
+/*
+ * mem_ctx_hugepages() - returns the number of bytes of the heap that are
+ *    backed by huge pages, as /proc/self/smaps reports them, or 0 if it
+ *    cannot tell
+ */
+size_t
+mem_ctx_hugepages(mem_ctx_t *ctx)
+{
+	FILE *fp;
+	struct mem_seg *seg;
+	char line[256];
+	unsigned long lo, hi, kb;
+	size_t total = 0;
+	int inside = 0;
+
+	if ((fp = fopen("/proc/self/smaps", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		/* Each mapping starts with a line "lo-hi perms ..." */
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+			inside = lo < (uintptr_t)ctx->mem_max_addr &&
+			    hi > (uintptr_t)ctx->mem_start_brk;
+			for (seg = ctx->segs; seg != NULL && !inside;
+			     seg = seg->next)
+				inside = lo < (uintptr_t)seg->addr + seg->len &&
+				    hi > (uintptr_t)seg->addr;
+		} else if (inside &&
+		    (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+			sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1))
+			total += kb * 1024;
+	}
+	fclose(fp);
+	return total;
+}
+
+/*
+ * The original interface, on the calling thread's current heap
+ */
+
+/*
+ * mem_set_pages - set the kind of pages that back the heaps created from
+ *    now on: MEM_PAGES_BASE, MEM_PAGES_THP or MEM_PAGES_HUGETLB
+ */
+void
+mem_set_pages(int mode)
+{
+	page_mode = mode;
+}
+
+/*
+ * mem_set_max_heap - set the size that mem_init's heap can grow to, up
+ *    to the limit of the address space, instead of MAX_HEAP
+ */
+void
+mem_set_max_heap(size_t size)
+{
+	max_heap_size = size;
+}
+
+/*
+ * mem_get_max_heap - return the size that mem_init's heap can grow to
+ */
+size_t
+mem_get_max_heap(void)
+{
+	return max_heap_size;
+}
+
+/*
+ * mem_init - initialize the memory system model
+ */
+void
+mem_init(void)
+{
+	default_ctx = mem_create(max_heap_size);
+}
+
+/*
+ * mem_deinit - free the storage used by the memory system model
+ */
+void
+mem_deinit(void)
+{
+	mem_destroy(default_ctx);
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ */
+void
+mem_reset_brk()
+{
+	mem_ctx_reset_brk(CUR_CTX());
+}
+
+/*
+ * mem_sbrk - extend the current heap by incr bytes (see mem_ctx_sbrk)
+ */
+void *
+mem_sbrk(intptr_t incr)
+{
+	return mem_ctx_sbrk(CUR_CTX(), incr);
+}
+
+/*
+ * mem_sbrk_avail - returns the most bytes that mem_sbrk can still extend
+ *    the current heap by
+ */
+size_t
+mem_sbrk_avail(void)
+{
+	return mem_ctx_sbrk_avail(CUR_CTX());
+}
+
+/*
+ * mem_map - map a segment of the current heap (see mem_ctx_map)
+ */
+void *
+mem_map(size_t len)
+{
+	return mem_ctx_map(CUR_CTX(), len);
+}
+
+/*
+ * mem_unmap - unmap a segment of the current heap (see mem_ctx_unmap)
+ */
+int
+mem_unmap(void *addr, size_t len)
+{
+	return mem_ctx_unmap(CUR_CTX(), addr, len);
+}
+
+/*
+ * mem_remap - resize a segment of the current heap (see mem_ctx_remap)
+ */
+void *
+mem_remap(void *addr, size_t len, size_t newlen)
+{
+	return mem_ctx_remap(CUR_CTX(), addr, len, newlen);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *
 mem_heap_lo()
 {
-	return (void *)mem_start_brk;
+	return mem_ctx_heap_lo(CUR_CTX());
 }
 
 /*
@@ -89,7 +685,17 @@ mem_heap_lo()
 void *
 mem_heap_hi()
 {
-	return (void *)(mem_brk - 1);
+	return mem_ctx_heap_hi(CUR_CTX());
+}
+
+/*
+ * mem_region - return the start and length of the part of the current
+ *    heap that holds addr (see mem_ctx_region)
+ */
+void *
+mem_region(void *addr, size_t *len)
+{
+	return mem_ctx_region(CUR_CTX(), addr, len);
 }
 
 /*
@@ -98,7 +704,43 @@ mem_heap_hi()
 size_t
 mem_heapsize()
 {
-	return (size_t)(mem_brk - mem_start_brk);
+	return mem_ctx_heapsize(CUR_CTX());
+}
+
+/*
+ * mem_release - empty the current heap and return its pages to the system
+ */
+void
+mem_release(void)
+{
+	mem_ctx_release(CUR_CTX());
+}
+
+/*
+ * mem_committed() - returns the bytes committed to the current heap
+ */
+size_t
+mem_committed(void)
+{
+	return mem_ctx_committed(CUR_CTX());
+}
+
+/*
+ * mem_resident() - returns the bytes of the current heap that are resident
+ */
+size_t
+mem_resident(void)
+{
+	return mem_ctx_resident(CUR_CTX());
+}
+
+/*
+ * mem_hugepages() - returns the bytes of the current heap in huge pages
+ */
+size_t
+mem_hugepages(void)
+{
+	return mem_ctx_hugepages(CUR_CTX());
 }
 
 /*
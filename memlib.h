@@ -1,8 +1,70 @@
+/*
+ * memlib.h - the simulated memory system
+ *
+ * Each simulated heap is a context.  The mem_ctx_* functions operate on an
+ * explicit context, so that several heaps can exist in one process.  The
+ * original functions operate on the calling thread's current context,
+ * which is the heap that mem_init creates unless mem_set_ctx has chosen
+ * another, so that the allocators that call them need not change.
+ *
+ * A heap reserves its maximum size of address space up front and commits
+ * pages as its break advances.  mem_committed and mem_resident report how
+ * much of it is committed and how much of that has actually been touched,
+ * and mem_hugepages how much is backed by huge pages (mem_set_pages).
+ * When the break cannot grow, which mem_sbrk_avail tells without the error
+ * that a failed mem_sbrk prints, an allocator can map more of the heap as
+ * separate segments with mem_map, resize them with mem_remap, and return
+ * them with mem_unmap.  mem_region tells which of them holds an address.
+ */
+#ifndef __MEMLIB_H_
+#define __MEMLIB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct mem_ctx mem_ctx_t;
+
+/* The kinds of pages that can back a heap (mem_set_pages) */
+enum { MEM_PAGES_BASE, MEM_PAGES_THP, MEM_PAGES_HUGETLB };
+
+mem_ctx_t *mem_create(size_t max_heap);
+void mem_destroy(mem_ctx_t *ctx);
+mem_ctx_t *mem_set_ctx(mem_ctx_t *ctx);
+mem_ctx_t *mem_get_ctx(void);
+void *mem_ctx_sbrk(mem_ctx_t *ctx, intptr_t incr);
+size_t mem_ctx_sbrk_avail(mem_ctx_t *ctx);
+void *mem_ctx_map(mem_ctx_t *ctx, size_t len);
+int mem_ctx_unmap(mem_ctx_t *ctx, void *addr, size_t len);
+void *mem_ctx_remap(mem_ctx_t *ctx, void *addr, size_t len, size_t newlen);
+void mem_ctx_reset_brk(mem_ctx_t *ctx);
+void mem_ctx_release(mem_ctx_t *ctx);
+void *mem_ctx_heap_lo(mem_ctx_t *ctx);
+void *mem_ctx_heap_hi(mem_ctx_t *ctx);
+void *mem_ctx_region(mem_ctx_t *ctx, void *addr, size_t *len);
+size_t mem_ctx_heapsize(mem_ctx_t *ctx);
+size_t mem_ctx_committed(mem_ctx_t *ctx);
+size_t mem_ctx_resident(mem_ctx_t *ctx);
+size_t mem_ctx_hugepages(mem_ctx_t *ctx);
+
+void mem_set_max_heap(size_t size);
+size_t mem_get_max_heap(void);
+void mem_set_pages(int mode);
 void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(intptr_t incr);
+size_t mem_sbrk_avail(void);
+void *mem_map(size_t len);
+int mem_unmap(void *addr, size_t len);
+void *mem_remap(void *addr, size_t len, size_t newlen);
 void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_region(void *addr, size_t *len);
 size_t mem_heapsize(void);
+void mem_release(void);
+size_t mem_committed(void);
+size_t mem_resident(void);
+size_t mem_hugepages(void);
 size_t mem_pagesize(void);
+
+#endif /* __MEMLIB_H_ */
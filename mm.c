@@ -13,13 +13,41 @@
  * define the size of a word.  This allocator also uses the standard
  * type uintptr_t to define unsigned integers that are the same size
  * as a pointer, i.e., sizeof(uintptr_t) == sizeof(void *).
+ *
+ * Built with -DMM_COMPACT, this file is instead the "compact" package, for
+ * heaps under 4 GB: headers and footers are 32-bit words, and the free
+ * list links are 32-bit offsets from the start of the heap, so that the
+ * minimum block size is 16 bytes rather than 32.  The heap then cannot
+ * grow past the break in mapped segments, which could lie anywhere in the
+ * address space.
  */
 
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#ifdef MM_COMPACT
+/* The compact package has names of its own, so both can be linked. */
+#define mm_init	      compact_init
+#define mm_malloc     compact_malloc
+#define mm_free	      compact_free
+#define mm_realloc    compact_realloc
+#define mm_heapwalk   compact_heapwalk
+#define mm_get_config compact_get_config
+#define mm_set_config compact_set_config
+#define mm_checkheap  compact_checkheap
+#define team	      compact_team
+#include "engine.h"
+#endif
 
 #include "memlib.h"
 #include "mm.h"
@@ -41,22 +69,83 @@ team_t team = {
 	"ay50"
 };
 
+typedef struct free_block *free_ptr;
+
+/* A link between free blocks, and the conversions to and from a block. */
+#ifdef MM_COMPACT
+typedef uint32_t link_t; /* Offset from heap_base; 0 is no block */
+#define NIL	     0
+#define TO_LINK(p)   ((link_t)((char *)(p)-heap_base))
+#define FROM_LINK(l) ((free_ptr)(heap_base + (l)))
+#else
+typedef free_ptr link_t;
+#define NIL	     NULL
+#define TO_LINK(p)   ((link_t)(p))
+#define FROM_LINK(l) (l)
+#endif
+
 struct free_block {
-	struct free_block *prev;
-	struct free_block *next;
+	link_t prev;
+	link_t next;
 };
 
-typedef struct free_block *free_ptr;
+/* Follow and set the links of free block p. */
+#define NEXT_FREE(p)	     FROM_LINK((p)->next)
+#define PREV_FREE(p)	     FROM_LINK((p)->prev)
+#define SET_NEXT_FREE(p, q) ((p)->next = TO_LINK(q))
+#define SET_PREV_FREE(p, q) ((p)->prev = TO_LINK(q))
+
+/*
+ * The heap is a list of segments in address order, and the free lists span
+ * all of them.  The first segment lies at the break and grows with
+ * mem_sbrk.  Once the break cannot grow, the heap grows by mapping more
+ * segments with mem_map, each of which is unmapped as soon as it is empty.
+ * Every segment starts with this header and a padding word, followed by a
+ * prologue block, its blocks and an epilogue header, so that coalescing
+ * stops at its ends.
+ */
+struct segment {
+	struct segment *next; /* Next segment in address order */
+	size_t size;	      /* Bytes in the segment */
+};
 
 /* Define basic constant for the number of size classes in segmented list */
 /* Classes are based on total block size, including memory overhead  */
 /* {32 - 64}, {65 - 128}, ..., {some number - inf} */
+/* This is the default; config.num_classes is the number in use. */
 #define NUM_CLASSES 15
 
+/* Default number of blocks that find_fit passes over in each class. */
+#define FIT_THRESHOLD 16
+
+/*
+ * With config.addr_order, each class keeps hints into its free list: a
+ * table of listed blocks, hashed by the region of HINT_BYTES they lie in,
+ * from which insert_node walks the list to a new block's place.  The
+ * table starts with as many slots per class as fit in a page and doubles
+ * as the heap grows, up to one slot per region or HINT_SLOTS.
+ */
+#define HINT_SLOTS 128 /* Most slots per class */
+#define HINT_SHIFT 16  /* log2(HINT_BYTES) */
+#define HINT_SPAN  4   /* Regions on either side that addr_next looks at */
+
+/* Given block ptr bp, compute its region, and the hint slot of a region. */
+#define REGION(bp) ((uintptr_t)(bp) >> HINT_SHIFT)
+#define HINT(cls, region) \
+	(addr_hint[(cls)*hint_slots + ((region) & (hint_slots - 1))])
+
 /* Basic constants and macros: */
-#define WSIZE	       sizeof(void *) /* Word and header/footer size (bytes) (8) */
+#ifdef MM_COMPACT
+typedef uint32_t word_t;
+#define ALIGN	     DSIZE		  /* Block size granularity (bytes) (8) */
+#define MAX_HEAP_SPAN ((size_t)1 << 32) /* Most bytes from heap_base */
+#else
+typedef uintptr_t word_t;
+#define ALIGN	     WSIZE		  /* Block size granularity (bytes) (8) */
+#endif
+#define WSIZE	       sizeof(word_t) /* Word and header/footer size (bytes) (8) */
 #define DSIZE	       (2 * WSIZE)    /* Doubleword size (bytes) (16) */
-#define CHUNKSIZE      (1 << 12)      /* Extend heap by this amount (bytes) */
+#define CHUNKSIZE      (1 << 12)      /* Default heap extension (bytes) */
 #define MIN_BLOCK_SIZE (2 * DSIZE)    /* Minimum block size (bytes) (32) */
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
@@ -66,15 +155,18 @@ typedef struct free_block *free_ptr;
 #define PACK(size, alloc) ((size) | (alloc))
 
 /* Read and write a word at address p. */
-#define GET(p)	    (*(uintptr_t *)(p))
-#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+#define GET(p)	    (*(word_t *)(p))
+#define PUT(p, val) (*(word_t *)(p) = (val))
 
 /* Read the size and allocated fields from address p. */
 #define GET_SIZE(p)  (GET(p) & ~(WSIZE - 1))
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
-/* Determine if prologue or epilogue */
-#define IS_FIRST_BLOCK(p) (GET_SIZE(HDRP(PREV_BLKP(p))) == 0)
+/* Marks the header of a listed free block while mm_checkheap runs. */
+#define MARK 0x2
+
+/* Determine if prologue or epilogue; no other block is DSIZE bytes */
+#define IS_FIRST_BLOCK(p) (GET_SIZE((char *)(p)-DSIZE) == DSIZE)
 #define IS_LAST_BLOCK(p)  (GET_SIZE(HDRP(NEXT_BLKP(p))) == 0)
 
 /* Given block ptr bp, compute address of its header and footer. */
@@ -85,24 +177,124 @@ typedef struct free_block *free_ptr;
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE)))
 
-#define GET_INDEX(size) (MIN(31 -__builtin_clz(size - 4), NUM_CLASSES - 1))
+/* Bytes of a segment that are not in its blocks */
+#define SEG_OVERHEAD (sizeof(struct segment) + 4 * WSIZE)
+
+/* Given segment ptr seg, compute address of its prologue, first block, end. */
+#define SEG_PROLOGUE(seg) ((char *)(seg) + sizeof(struct segment) + DSIZE)
+#define SEG_FIRST(seg)	  (SEG_PROLOGUE(seg) + DSIZE)
+#define SEG_END(seg)	  ((char *)(seg) + (seg)->size)
+
+/* Given the first block bp of a segment, compute address of the segment. */
+#define BLK_SEG(bp) \
+	((struct segment *)((char *)(bp)-2 * DSIZE - sizeof(struct segment)))
+
+#define GET_INDEX(size) \
+	(MIN(31 -__builtin_clz(size - 4), config.num_classes - 1))
+
+/*
+ * With config.side_index, the free blocks of each class are not linked but
+ * listed in a side index: an array of their sizes, which find_fit scans
+ * without touching the blocks, and an array of the blocks in the same
+ * order.  A free block holds its slot in the arrays in its first word.
+ * Blocks are appended, and a removed block leaves a size of 0 behind, so
+ * that the slots are in the order of the list they replace and removing a
+ * block touches nothing but the index.  When a class fills up, its live
+ * slots are packed to the front, or if more than half are live, its
+ * arrays get twice the room: the arrays of all classes share one segment
+ * mapped with mem_map, which grows in place with mem_remap, and the
+ * arrays that lie after its move up to make room.  find_fit scans the
+ * size arrays with the widest vector compare the CPU has, chosen at run
+ * time by mm_init, or with the one that MM_FIRST_FIT names.
+ */
+struct side_index {
+	uint32_t *sizes; /* Block sizes, UINT32_MAX if 4 GB or larger */
+	char **blocks;	 /* The blocks */
+	uint32_t head;	 /* First slot that may be live */
+	uint32_t count;	 /* Slots used */
+	uint32_t live;	 /* Slots that hold a block */
+	uint32_t cap;	 /* Room in the arrays, a multiple of 8 */
+};
+
+#define SIDE_MIN_CAP 16 /* Initial room per class */
+#define SIDE_ENTRY   (sizeof(uint32_t) + sizeof(char *))
+
+/* A scan of a size array for the first entry that fits */
+typedef uint32_t (*first_fit_t)(const uint32_t *, uint32_t, uint32_t);
+
+/* Read and write the slot of a free block in a side index. */
+#define SLOT(bp) (*(uint32_t *)(bp))
 
 /* Global variables: */
-static char *heap_listp; /* Pointer to first block */
+static struct segment *seg_list; /* Segments in address order */
+static struct segment *brk_seg;	 /* The segment at the break */
+static bool brk_blocked;	 /* Whether mem_sbrk has failed */
 static free_ptr fb_list;
+static struct side_index side[MM_MAX_CLASSES];
+static free_ptr *addr_hint; /* The hints, with config.addr_order */
+static size_t hint_slots;   /* Slots per class, a power of 2 */
+static char *side_map;	/* The segment that holds the side index */
+static size_t side_len; /* Bytes in that segment */
+
+/* The scan of a size array that this CPU runs fastest, set by mm_init */
+static first_fit_t first_fit;
+#ifdef MM_COMPACT
+static char *heap_base; /* Where the links are offsets from */
+#endif
+
+/* The policy of the current heap, and of the next one mm_init makes */
+static mm_config_t config;
+static mm_config_t pending = { FIT_THRESHOLD, NUM_CLASSES, CHUNKSIZE,
+	MIN_BLOCK_SIZE, 0, 0 };
 
 /* Function prototypes for internal helper routines: */
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
+static void *new_segment(void *p, size_t size);
+static void release_segment(void *bp);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
 
 static void insert_node(void *bp);
 static void remove_node(void *bp);
+static free_ptr addr_next(void *bp, int cls);
+static void unhint(free_ptr bp, free_ptr repl);
+static bool hint_grow(void);
+
+static bool side_grow(int cls);
+static void side_pack(struct side_index *si);
+static void *side_find(int cls, size_t asize);
+static void side_to_lists(void);
+
+static uint32_t first_fit_scalar(const uint32_t *sizes, uint32_t n,
+    uint32_t want);
+#if defined(__x86_64__) || defined(__i386__)
+static uint32_t first_fit_avx2(const uint32_t *sizes, uint32_t n,
+    uint32_t want);
+#endif
+#ifdef __SSE2__
+static uint32_t first_fit_sse2(const uint32_t *sizes, uint32_t n,
+    uint32_t want);
+#endif
+#ifdef __aarch64__
+static uint32_t first_fit_neon(const uint32_t *sizes, uint32_t n,
+    uint32_t want);
+#endif
+
+static bool valid_config(const mm_config_t *c);
+static void read_env(void);
+static first_fit_t choose_first_fit(void);
+
+#ifdef MM_COMPACT
+const engine_t compact_engine = { "compact",
+	"segregated fits, 32-bit words (mm.c -DMM_COMPACT)", mm_init,
+	mm_malloc, mm_free, mm_realloc, mm_checkheap, mm_heapwalk, 1 };
+#endif
 
 /* Function prototypes for heap consistency checker routines: */
-static void checkblock(void *bp);
-static void checkheap(bool verbose);
+static bool inheap(const void *bp);
+static int check_side(size_t *listed);
+static void clear_marks(const size_t *marked);
 static void printblock(void *bp);
 
 /*
@@ -116,37 +308,50 @@ static void printblock(void *bp);
 int
 mm_init(void)
 {
+	/* Start the heap with the configured policy */
+	read_env();
+	config = pending;
+
+#ifdef MM_COMPACT
+	/* Offset 0 is the null link, so no block may lie there. */
+	if ((heap_base = mem_sbrk(DSIZE)) == (void *)-1)
+		return (-1);
+#endif
+
 	/* Initialize fb_list */
-	if ((fb_list = mem_sbrk(NUM_CLASSES * DSIZE)) == (void *)-1)
+	if ((fb_list = mem_sbrk(config.num_classes *
+	    sizeof(struct free_block))) == (void *)-1)
 		return (-1);
 
 	/* Initialize segregated fits free list */
-	for (int i = 0; i < NUM_CLASSES; i++) {
-		fb_list[i].prev = &fb_list[i];
-		fb_list[i].next = &fb_list[i];
+	for (int i = 0; i < config.num_classes; i++) {
+		SET_PREV_FREE(&fb_list[i], &fb_list[i]);
+		SET_NEXT_FREE(&fb_list[i], &fb_list[i]);
 	}
 
-	/* Initialize heap */
-	if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+	/* Map the address order hints, if they are to be used */
+	addr_hint = NULL;
+	hint_slots = 0;
+	if (config.addr_order && !hint_grow())
 		return (-1);
 
-	/* Alignment padding */
-	PUT(heap_listp, 0);
-
-	/* Prologue header */
-	PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1));
-
-	/* Prologue footer */
-	PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));
-
-	/* Epilogue header */
-	PUT(heap_listp + (3 * WSIZE), PACK(0, 1));
+	/* Initialize the side index, if it is to be used */
+	side_map = NULL;
+	side_len = 0;
+	memset(side, 0, sizeof(side));
+	first_fit = choose_first_fit();
+	if (config.side_index && !side_grow(-1))
+		return (-1);
 
-	/* Increment the heap_list pointer */
-	heap_listp += (2 * WSIZE);
+	/* Initialize heap with an empty segment at the break */
+	if ((brk_seg = mem_sbrk(SEG_OVERHEAD)) == (void *)-1)
+		return (-1);
+	seg_list = NULL;
+	brk_blocked = false;
+	new_segment(brk_seg, SEG_OVERHEAD);
 
-	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
-	if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+	/* Extend the empty heap with a free block of chunksize bytes. */
+	if (extend_heap(config.chunksize / WSIZE) == NULL)
 		return (-1);
 
 	return (0);
@@ -173,13 +378,19 @@ mm_malloc(size_t size)
 	if (size == 0)
 		return (NULL);
 
+#ifdef MM_COMPACT
+	/* No block can be 4 GB or larger. */
+	if (size >= MAX_HEAP_SPAN)
+		return (NULL);
+#endif
+
 	/* Adjust block size */
 	if (size <= DSIZE)
 		/* 2 DSIZE for header, footer, and pointers */
 		asize = 2 * DSIZE;
 	else
-		/* Round up to the nearest WSIZE and add DSIZE for hdr and ftr*/
-		asize = WSIZE * ((size + DSIZE + (WSIZE - 1)) / WSIZE);
+		/* Round up to the nearest ALIGN and add DSIZE for hdr and ftr*/
+		asize = ALIGN * ((size + DSIZE + (ALIGN - 1)) / ALIGN);
 
 	/* Search the free list for a fit. */
 	if ((bp = find_fit(asize)) != NULL) {
@@ -188,9 +399,11 @@ mm_malloc(size_t size)
 	}
 
 	/* No fit found.  Get more memory and place the block. */
-	extendsize = MAX(asize, CHUNKSIZE);
+	extendsize = MAX(asize, config.chunksize);
 	if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
 		return (NULL);
+	if (config.addr_order)
+		hint_grow();
 	place(bp, asize);
 	return (bp);
 }
@@ -215,7 +428,11 @@ mm_free(void *bp)
 	size = GET_SIZE(HDRP(bp));
 	PUT(HDRP(bp), PACK(size, 0));
 	PUT(FTRP(bp), PACK(size, 0));
-	coalesce(bp);
+	bp = coalesce(bp);
+
+	/* Unmap a mapped segment once it is empty. */
+	if (IS_FIRST_BLOCK(bp) && IS_LAST_BLOCK(bp) && BLK_SEG(bp) != brk_seg)
+		release_segment(bp);
 }
 
 /*
@@ -259,11 +476,23 @@ mm_realloc(void *ptr, size_t size)
 	if (size <= DSIZE)
 		asize = 2 * DSIZE;
 	else
-		asize = WSIZE * ((size + DSIZE + (WSIZE - 1)) / WSIZE);
+		asize = ALIGN * ((size + DSIZE + (ALIGN - 1)) / ALIGN);
 
 	/* Try to reuse current block if possible. */
 	if (oldsize >= asize) {
-		place(ptr, asize);
+		/*
+		 * The block is allocated, so it is not on a free list and
+		 * place() must not be used.  Split off and free any tail
+		 * that is large enough to be a block of its own.
+		 */
+		if (oldsize - asize >= config.split_min) {
+			PUT(HDRP(ptr), PACK(asize, 1));
+			PUT(FTRP(ptr), PACK(asize, 1));
+			newptr = NEXT_BLKP(ptr);
+			PUT(HDRP(newptr), PACK(oldsize - asize, 0));
+			PUT(FTRP(newptr), PACK(oldsize - asize, 0));
+			coalesce(newptr);
+		}
 		return ptr;
 	}
 
@@ -298,10 +527,194 @@ mm_realloc(void *ptr, size_t size)
 	return (newptr);
 }
 
+/*
+ * Requires:
+ *   "visit" is a function that does not change the heap.
+ *
+ * Effects:
+ *   Calls "visit" for every block between the prologue and the epilogue,
+ *   in address order, passing "arg" along.
+ */
+void
+mm_heapwalk(mm_visit_t visit, void *arg)
+{
+	struct segment *seg;
+	char *bp;
+	size_t size;
+	bool alloc;
+
+	for (seg = seg_list; seg != NULL; seg = seg->next) {
+		for (bp = SEG_FIRST(seg); (size = GET_SIZE(HDRP(bp))) > 0;
+		     bp = NEXT_BLKP(bp)) {
+			alloc = GET_ALLOC(HDRP(bp));
+			visit(HDRP(bp), size, alloc,
+			    alloc ? -1 : GET_INDEX(size), arg);
+		}
+	}
+}
+
+/*
+ * Requires:
+ *   "c" is not NULL.
+ *
+ * Effects:
+ *   Store the policy that the next call to mm_init will use in "c".  It is
+ *   the default policy, overridden by the MM_* environment variables and
+ *   then by any call to mm_set_config.
+ */
+void
+mm_get_config(mm_config_t *c)
+{
+	read_env();
+	*c = pending;
+}
+
+/*
+ * Requires:
+ *   "c" is not NULL.
+ *
+ * Effects:
+ *   Make "c" the policy of the heaps that later calls to mm_init make.  The
+ *   current heap keeps its policy.  Returns 0 if "c" is a valid policy and
+ *   -1, leaving the policy unchanged, otherwise.
+ */
+int
+mm_set_config(const mm_config_t *c)
+{
+	read_env();
+	if (!valid_config(c))
+		return (-1);
+	pending = *c;
+	pending.chunksize = DSIZE * ((c->chunksize + DSIZE - 1) / DSIZE);
+	return (0);
+}
+
 /*
  * The following routines are internal helper routines.
  */
 
+/*
+ * Requires:
+ *   "c" is not NULL.
+ *
+ * Effects:
+ *   Returns true if "c" is a policy that the allocator can run with.
+ */
+static bool
+valid_config(const mm_config_t *c)
+{
+	return (c->num_classes >= 1 && c->num_classes <= MM_MAX_CLASSES &&
+	    c->chunksize >= MIN_BLOCK_SIZE && c->chunksize <= (1UL << 30) &&
+	    c->split_min >= MIN_BLOCK_SIZE &&
+	    (c->side_index == 0 || c->side_index == 1) &&
+	    (c->addr_order == 0 || c->addr_order == 1) &&
+	    !(c->side_index && c->addr_order));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   The first time it is called, override the default policy with the
+ *   MM_FIT_THRESHOLD, MM_NUM_CLASSES, MM_CHUNKSIZE, MM_SPLIT_MIN,
+ *   MM_SIDE_INDEX and MM_ADDR_ORDER environment variables.  A variable
+ *   that does not hold a number that makes a valid policy is reported and
+ *   ignored.
+ */
+static void
+read_env(void)
+{
+	static const char *names[] = { "MM_FIT_THRESHOLD", "MM_NUM_CLASSES",
+		"MM_CHUNKSIZE", "MM_SPLIT_MIN", "MM_SIDE_INDEX",
+		"MM_ADDR_ORDER" };
+	static bool done = false;
+	mm_config_t c;
+	const char *val;
+	char *end;
+	long n;
+
+	if (done)
+		return;
+	done = true;
+	for (int i = 0; i < 6; i++) {
+		if ((val = getenv(names[i])) == NULL)
+			continue;
+		n = strtol(val, &end, 0);
+		c = pending;
+		switch (i) {
+		case 0:
+			c.fit_threshold = n;
+			break;
+		case 1:
+			c.num_classes = n;
+			break;
+		case 2:
+			c.chunksize = (n < 0) ? 0 : n;
+			break;
+		case 3:
+			c.split_min = (n < 0) ? 0 : n;
+			break;
+		case 4:
+			c.side_index = n;
+			break;
+		default:
+			c.addr_order = n;
+		}
+		if (*val == '\0' || *end != '\0' || n < INT_MIN || n > INT_MAX ||
+		    !valid_config(&c)) {
+			fprintf(stderr, "mm: ignoring %s=%s\n", names[i], val);
+			continue;
+		}
+		pending = c;
+		pending.chunksize = DSIZE * ((c.chunksize + DSIZE - 1) / DSIZE);
+	}
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Returns the first_fit kernel that mm_init should use: the widest that
+ *   this CPU runs, unless the MM_FIRST_FIT environment variable names
+ *   another that it runs ("scalar", "sse2", "avx2" or "neon"), so that
+ *   the kernels can be compared.  A name that is not one of those is
+ *   reported the first time.
+ */
+static first_fit_t
+choose_first_fit(void)
+{
+	static bool warned = false;
+	first_fit_t best;
+	const char *val = getenv("MM_FIRST_FIT");
+
+	best = first_fit_scalar;
+#ifdef __SSE2__
+	best = first_fit_sse2;
+	if (val != NULL && !strcmp(val, "sse2"))
+		return (first_fit_sse2);
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2")) {
+		best = first_fit_avx2;
+		if (val != NULL && !strcmp(val, "avx2"))
+			return (first_fit_avx2);
+	}
+#elif defined(__aarch64__)
+	best = first_fit_neon;
+	if (val != NULL && !strcmp(val, "neon"))
+		return (first_fit_neon);
+#endif
+	if (val != NULL && !strcmp(val, "scalar"))
+		return (first_fit_scalar);
+	if (val != NULL && !warned) {
+		fprintf(stderr, "mm: ignoring MM_FIRST_FIT=%s\n", val);
+		warned = true;
+	}
+	return (best);
+}
+
 /*
  * Requires:
  *   "bp" is the address of a newly freed block.
@@ -350,26 +763,112 @@ coalesce(void *bp)
  *   None.
  *
  * Effects:
- *   Extend the heap with a free block and return that block's address.
+ *   Extend the heap with a free block of at least "words" words and return
+ *   that block's address.  The block extends the segment at the break, or
+ *   if the break cannot grow, is a newly mapped segment of its own.
  */
 static void *
 extend_heap(size_t words)
 {
 	size_t size;
+#ifndef MM_COMPACT
+	size_t pagesize;
+#endif
 	void *bp;
 
 	/* Allocate an even number of words to maintain alignment. */
 	size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-	if ((bp = mem_sbrk(size)) == (void *)-1)
+#ifdef MM_COMPACT
+	/* Every offset and block size must fit in a word. */
+	if (size >= MAX_HEAP_SPAN - (size_t)(SEG_END(brk_seg) - heap_base))
 		return (NULL);
-	
-	/* Initialize free block header/footer and the epilogue header. */
-	PUT(HDRP(bp), PACK(size, 0));	      /* Free block header */
-	PUT(FTRP(bp), PACK(size, 0));	      /* Free block footer */
-	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+#endif
+	/* Ask first, since a failed mem_sbrk reports an error. */
+	if (!brk_blocked && size <= mem_sbrk_avail()) {
+		if ((bp = mem_sbrk(size)) != (void *)-1) {
+			brk_seg->size += size;
+
+			/*
+			 * Initialize free block header/footer and the
+			 * epilogue header.
+			 */
+			PUT(HDRP(bp), PACK(size, 0));
+			PUT(FTRP(bp), PACK(size, 0));
+			PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+
+			/* Coalesce if the previous block was free. */
+			return (coalesce(bp));
+		}
+		brk_blocked = true;
+	}
+#ifdef MM_COMPACT
+	/* A mapped segment could lie too far from heap_base for a link. */
+	return (NULL);
+#else
+
+	/* Map a segment of whole pages that holds the block. */
+	pagesize = mem_pagesize();
+	size = (size + SEG_OVERHEAD + pagesize - 1) / pagesize * pagesize;
+	if ((bp = mem_map(size)) == (void *)-1)
+		return (NULL);
+	return (new_segment(bp, size));
+#endif
+}
+
+/*
+ * Requires:
+ *   "p" is the address of "size" bytes that are not in the heap, and "size"
+ *   is a multiple of DSIZE that is at least SEG_OVERHEAD.
+ *
+ * Effects:
+ *   Make a segment of the "size" bytes at "p" and add it to the heap.  Any
+ *   space between its prologue and epilogue becomes a free block.  Returns
+ *   the address of the segment's first block.
+ */
+static void *
+new_segment(void *p, size_t size)
+{
+	struct segment *seg = p, **segp;
+	char *bp = SEG_FIRST(seg);
+
+	seg->size = size;
+	PUT(SEG_PROLOGUE(seg) - DSIZE, 0);	      /* Padding */
+	PUT(HDRP(SEG_PROLOGUE(seg)), PACK(DSIZE, 1)); /* Prologue header */
+	PUT(FTRP(SEG_PROLOGUE(seg)), PACK(DSIZE, 1)); /* Prologue footer */
+	PUT(SEG_END(seg) - WSIZE, PACK(0, 1));	      /* Epilogue header */
+	if (size > SEG_OVERHEAD) {
+		PUT(HDRP(bp), PACK(size - SEG_OVERHEAD, 0));
+		PUT(FTRP(bp), PACK(size - SEG_OVERHEAD, 0));
+		insert_node(bp);
+	}
 
-	/* Coalesce if the previous block was free. */
-	return (coalesce(bp));
+	/* Keep the segments in address order. */
+	for (segp = &seg_list; *segp != NULL && *segp < seg;
+	     segp = &(*segp)->next)
+		;
+	seg->next = *segp;
+	*segp = seg;
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is a free block that fills a segment other than the one at the
+ *   break.
+ *
+ * Effects:
+ *   Remove the segment from the heap and unmap it.
+ */
+static void
+release_segment(void *bp)
+{
+	struct segment *seg = BLK_SEG(bp), **segp;
+
+	remove_node(bp);
+	for (segp = &seg_list; *segp != seg; segp = &(*segp)->next)
+		;
+	*segp = seg->next;
+	mem_unmap(seg, seg->size);
 }
 
 /*
@@ -384,16 +883,29 @@ static void *
 find_fit(size_t asize)
 {
 	int classIdx = GET_INDEX(asize);
-	while (classIdx < NUM_CLASSES) {
+	void *bp;
+
+	if (config.side_index) {
+		for (; classIdx < config.num_classes; classIdx++)
+			if ((bp = side_find(classIdx, asize)) != NULL)
+				return (bp);
+		return (NULL);
+	}
+	while (classIdx < config.num_classes) {
 		int counter = 0;
-		int threshold = 16;
+		/*
+		 * An address-ordered list starts with its oldest, most
+		 * fragmented blocks, so a bounded scan of it would seldom
+		 * get past them.
+		 */
+		int threshold = config.addr_order ? -1 : config.fit_threshold;
 		free_ptr head = &fb_list[classIdx];
-		free_ptr curr = head->next;
-		while (curr != head && counter <= threshold) {
+		free_ptr curr = NEXT_FREE(head);
+		while (curr != head && (threshold < 0 || counter <= threshold)) {
 			if (GET_SIZE(HDRP(curr)) >= asize) {
 				return curr;
 			}
-			curr = curr->next;
+			curr = NEXT_FREE(curr);
 			counter++;
 		}
 		classIdx++;
@@ -416,7 +928,22 @@ place(void *bp, size_t asize)
 	/* Move split free block to lower class */
 	/* Remove split allocated block from linked lists */
 	size_t csize = GET_SIZE(HDRP(bp));
-	if ((csize - asize) >= (MIN_BLOCK_SIZE)) {
+	free_ptr rest;
+
+	if ((csize - asize) >= config.split_min && config.addr_order &&
+	    GET_INDEX(csize - asize) == GET_INDEX(csize)) {
+		/* The rest takes bp's place, which keeps the list in order */
+		rest = (free_ptr)((char *)bp + asize);
+		unhint(bp, rest);
+		PUT(HDRP(rest), PACK(csize - asize, 0));
+		PUT(FTRP(rest), PACK(csize - asize, 0));
+		SET_NEXT_FREE(rest, NEXT_FREE((free_ptr)bp));
+		SET_PREV_FREE(rest, PREV_FREE((free_ptr)bp));
+		SET_NEXT_FREE(PREV_FREE(rest), rest);
+		SET_PREV_FREE(NEXT_FREE(rest), rest);
+		PUT(HDRP(bp), PACK(asize, 1));
+		PUT(FTRP(bp), PACK(asize, 1));
+	} else if ((csize - asize) >= config.split_min) {
 		remove_node(bp);
 		PUT(HDRP(bp), PACK(asize, 1));
 		PUT(FTRP(bp), PACK(asize, 1));
@@ -431,46 +958,31 @@ place(void *bp, size_t asize)
 	}
 }
 
-/*
- * Requires:
- *   "bp" is the address of a block.
- *
- * Effects:
- *   Perform a search in the free lists for a free block "bp" in the heap.
- */
-static bool
-isblockinfreelist(void *bp)
-{
-	for (int i = 0; i < NUM_CLASSES; i++) {
-		void *curr = fb_list[i].next;
-		// loop through circular linked list for size class i
-		while (curr != &fb_list[i]) {
-			if (curr == bp) {
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
 /*
  * The remaining routines are heap consistency checker routines.
  */
 
 /*
  * Requires:
- *   "bp" is the address of a block.
+ *   None.
  *
  * Effects:
- *   Perform a minimal check on the block "bp".
+ *   Returns true if "bp" could be the payload address of a block, that is,
+ *   if it is word aligned and lies between the prologue and the epilogue
+ *   of a segment.
  */
-static void
-checkblock(void *bp)
+static bool
+inheap(const void *bp)
 {
-	if ((uintptr_t)bp % DSIZE)
-		printf("Error: %p is not doubleword aligned\n", bp);
-	if (GET(HDRP(bp)) != GET(FTRP(bp)))
-		printf("Error: header does not match footer\n");
+	struct segment *seg;
+
+	if ((uintptr_t)bp % WSIZE != 0)
+		return (false);
+	for (seg = seg_list; seg != NULL; seg = seg->next)
+		if ((const char *)bp > SEG_PROLOGUE(seg) &&
+		    (const char *)bp <= SEG_END(seg) - WSIZE)
+			return (true);
+	return (false);
 }
 
 /*
@@ -478,73 +990,301 @@ checkblock(void *bp)
  *   None.
  *
  * Effects:
- *   Perform a minimal check of the heap for consistency.
+ *   Check the heap for consistency, printing a line for each problem found,
+ *   and return the number of problems.  The check takes time linear in the
+ *   number of blocks, so that the driver can run it after every request.
+ *
+ *   The first pass follows each free list, checking its links and the
+ *   blocks on it, and marks every listed block by setting the MARK bit of
+ *   its header.  The second pass walks the heap in address order, checking
+ *   every block and clearing the marks; a free block that is not marked is
+ *   missing from the free lists.  Finally, the number of listed blocks is
+ *   checked against the number of free blocks in the heap.  If the free
+ *   lists point outside the heap, marks may be left in payloads, but by
+ *   then the heap is already corrupt.
  */
-void
-checkheap(bool verbose)
+int
+mm_checkheap(int verbose)
 {
-	void *bp;
+	struct segment *seg;
+	free_ptr head, curr, next;
+	char *bp, *prologue, *end;
+	uintptr_t hdr;
+	size_t listed = 0, nfree = 0, marked[MM_MAX_CLASSES];
+	bool prev_free, at_brk = false, lost = false;
+	int errors = 0;
+
+	/* Mark every block on the free lists. */
+	for (int i = 0; i < config.num_classes; i++) {
+		head = &fb_list[i];
+		marked[i] = listed;
+		for (curr = NEXT_FREE(head); curr != head; curr = next) {
+			if (!inheap(curr)) {
+				printf("Error: free list %d points to %p, outside "
+				       "the heap\n", i, (void *)curr);
+				errors++;
+				break;
+			}
+			hdr = GET(HDRP(curr));
+			if (hdr & MARK) {
+				printf("Error: %p is on the free lists twice\n",
+				    (void *)curr);
+				errors++;
+				break;
+			}
+			PUT(HDRP(curr), hdr | MARK);
+			listed++;
+			if (hdr & 0x1) {
+				printf("Error: allocated block %p is on free "
+				       "list %d\n", (void *)curr, i);
+				errors++;
+			} else if (GET_INDEX(GET_SIZE(HDRP(curr))) != i) {
+				printf("Error: %p of size %zu is on free list "
+				       "%d\n", (void *)curr,
+				    (size_t)GET_SIZE(HDRP(curr)), i);
+				errors++;
+			}
+			next = NEXT_FREE(curr);
+			if (next != head && !inheap(next))
+				continue;	/* Reported on the next iteration */
+			if (PREV_FREE(next) != curr) {
+				printf("Error: free list %d is broken after "
+				       "%p\n", i, (void *)curr);
+				errors++;
+				break;
+			}
+			if (config.addr_order && next != head &&
+			    (char *)next <= (char *)curr) {
+				printf("Error: free list %d is out of address "
+				       "order after %p\n", i, (void *)curr);
+				errors++;
+			}
+		}
+		marked[i] = listed - marked[i];
+	}
 
-	if (verbose)
-		printf("Heap (%p):\n", heap_listp);
+	/* Mark every block in the side index. */
+	if (config.side_index)
+		errors += check_side(&listed);
+
+	/* Every address order hint must be to a listed block of its class. */
+	for (size_t i = 0; config.addr_order &&
+	     i < config.num_classes * hint_slots; i++) {
+		curr = addr_hint[i];
+		if (curr != NULL && (!inheap(curr) ||
+		    !(GET(HDRP(curr)) & MARK) ||
+		    (size_t)GET_INDEX(GET_SIZE(HDRP(curr))) != i / hint_slots)) {
+			printf("Error: hint %zu points to %p, which is not on "
+			       "free list %zu\n", i % hint_slots, (void *)curr,
+			    i / hint_slots);
+			errors++;
+		}
+	}
 
-	if (GET_SIZE(HDRP(heap_listp)) != DSIZE || !GET_ALLOC(HDRP(heap_listp)))
-		printf("Bad prologue header\n");
-	checkblock(heap_listp);
+	/* Walk each segment of the heap, clearing the marks. */
+	for (seg = seg_list; seg != NULL; seg = seg->next) {
+		prologue = SEG_PROLOGUE(seg);
+		end = SEG_END(seg);
+		if (verbose)
+			printf("Segment %p (%zu bytes):\n", (void *)seg,
+			    seg->size);
+		if (seg->next != NULL && (char *)seg->next < end) {
+			printf("Error: segment %p overlaps the next one\n",
+			    (void *)seg);
+			errors++;
+		}
+		if (seg == brk_seg) {
+			at_brk = true;
+			if (end != (char *)mem_sbrk(0)) {
+				printf("Error: segment %p does not end at the "
+				       "break\n", (void *)seg);
+				errors++;
+			}
+		}
+		if (GET_SIZE(HDRP(prologue)) != DSIZE ||
+		    !GET_ALLOC(HDRP(prologue)) ||
+		    GET(HDRP(prologue)) != GET(FTRP(prologue))) {
+			printf("Error: bad prologue header at %p\n",
+			    HDRP(prologue));
+			errors++;
+		}
 
-	if (verbose)
-		printblock(bp);
-	if (GET_SIZE(HDRP(bp)) != 0 || !GET_ALLOC(HDRP(bp)))
-		printf("Bad epilogue header\n");
+		prev_free = false;
+		for (bp = SEG_FIRST(seg); GET_SIZE(HDRP(bp)) > 0;
+		     bp = NEXT_BLKP(bp)) {
+			hdr = GET(HDRP(bp));
+			PUT(HDRP(bp), hdr & ~MARK);
+			if (verbose)
+				printblock(bp);
+			if (GET_SIZE(HDRP(bp)) < MIN_BLOCK_SIZE ||
+			    (char *)bp + GET_SIZE(HDRP(bp)) > end) {
+				printf("Error: %p has a bad size %zu\n", bp,
+				    (size_t)GET_SIZE(HDRP(bp)));
+				errors++;
+				break;
+			}
+			if (GET(HDRP(bp)) != GET(FTRP(bp))) {
+				printf("Error: header of %p does not match "
+				       "footer\n", bp);
+				errors++;
+			}
+			if (hdr & 0x1) {
+				prev_free = false;
+				continue;
+			}
+			nfree++;
+			if (!(hdr & MARK)) {
+				printf("Error: free block %p is not on a free "
+				       "list\n", bp);
+				errors++;
+			}
+			if (prev_free) {
+				printf("Error: free block %p was not coalesced "
+				       "with the block before it\n", bp);
+				errors++;
+			}
+			prev_free = true;
+		}
+		if (GET_SIZE(HDRP(bp)) > 0) {
+			/* The rest of the segment cannot be walked. */
+			lost = true;
+			continue;
+		}
 
-	/* Iterate through the heap. */
-	for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
 		if (verbose)
 			printblock(bp);
-		checkblock(bp);
-
-		/* Checks if every free block is actually in the free list. */
-		if (!GET_ALLOC(HDRP(bp))) {
-			if (!isblockinfreelist(bp)) {
-				printf("Free block not in free list.\n");
-			}
+		if (!GET_ALLOC(HDRP(bp)) || HDRP(bp) != end - WSIZE) {
+			printf("Error: bad epilogue header at %p\n", HDRP(bp));
+			errors++;
 		}
+	}
+	if (!at_brk) {
+		printf("Error: the segment at the break is missing\n");
+		errors++;
+	}
+	if (lost) {
+		/* The blocks past a bad size may still be marked. */
+		clear_marks(marked);
+	} else if (listed != nfree) {
+		printf("Error: %zu blocks on the free lists but %zu free "
+		       "blocks in the heap\n", listed, nfree);
+		errors++;
+	}
+	return (errors);
+}
 
-		/* Checks if any allocated blocks overlap. */
-		if (GET_ALLOC(HDRP(bp)) && GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
-			if ((uintptr_t)mem_heap_lo() >
-				(uintptr_t)NEXT_BLKP(bp) ||
-			    (uintptr_t)mem_heap_hi() < (uintptr_t)bp) {
-				printf("Overlap between allocated blocks\n");
+/*
+ * Requires:
+ *   The side index is in use.
+ *
+ * Effects:
+ *   Check every block in the side index as mm_checkheap checks the blocks
+ *   on the free lists, and mark it.  Adds the number of blocks to
+ *   "listed" and returns the number of problems found.
+ */
+static int
+check_side(size_t *listed)
+{
+	struct side_index *si;
+	char *bp;
+	uintptr_t hdr;
+	uint32_t live;
+	int errors = 0;
+
+	for (int i = 0; i < config.num_classes; i++) {
+		si = &side[i];
+		if (si->head > si->count || si->count > si->cap) {
+			printf("Error: side index %d uses slots %u to %u of "
+			       "%u\n", i, si->head, si->count, si->cap);
+			errors++;
+			continue;
+		}
+		live = 0;
+		for (uint32_t j = si->head; j < si->count; j++)
+			live += (si->sizes[j] != 0);
+		if (live != si->live ||
+		    (si->head < si->count && si->sizes[si->head] == 0)) {
+			printf("Error: side index %d does not have %u live "
+			       "slots from slot %u on\n", i, si->live,
+			    si->head);
+			errors++;
+		}
+		for (uint32_t j = 0; j < si->count; j++) {
+			if (si->sizes[j] == 0)
+				continue;
+			bp = si->blocks[j];
+			if (j < si->head) {
+				printf("Error: side index %d holds %p before "
+				       "its first slot %u\n", i, bp, si->head);
+				errors++;
+			}
+			if (!inheap(bp)) {
+				printf("Error: side index %d points to %p, "
+				       "outside the heap\n", i, bp);
+				errors++;
+				continue;
+			}
+			hdr = GET(HDRP(bp));
+			if (hdr & MARK) {
+				printf("Error: %p is in the side index twice\n",
+				    bp);
+				errors++;
+				continue;
+			}
+			PUT(HDRP(bp), hdr | MARK);
+			(*listed)++;
+			if (hdr & 0x1) {
+				printf("Error: allocated block %p is in side "
+				       "index %d\n", bp, i);
+				errors++;
+			} else if (GET_INDEX(GET_SIZE(HDRP(bp))) != i) {
+				printf("Error: %p of size %zu is in side index "
+				       "%d\n", bp, (size_t)GET_SIZE(HDRP(bp)),
+				    i);
+				errors++;
+			}
+			if (si->sizes[j] != MIN(GET_SIZE(HDRP(bp)), UINT32_MAX) ||
+			    SLOT(bp) != j) {
+				printf("Error: side index %d has a stale entry "
+				       "for %p\n", i, bp);
+				errors++;
 			}
 		}
 	}
+	return (errors);
+}
 
-	// Are there any contiguous free blocks that somehow escaped coalescing?
-	// Do the pointers in the free list point to valid free blocks?
-	for (int i = 0; i < NUM_CLASSES; i++) {
-		free_ptr curr = fb_list[i].next;
-		// loop through circular linked list for size class i
-		while (curr != &fb_list[i]) {
-			if (GET_ALLOC(curr)) {
-				printf("Allocated block in free list\n");
-			} else {
-				// check if prev block is free, given that curr
-				// is not the first block
-				if (!IS_FIRST_BLOCK(curr) &&
-				    !GET_ALLOC(HDRP(PREV_BLKP(curr)))) {
-					printf(
-					    "Previous free block not coalesced\n");
-				}
-				/* Check if next block is free, given that curr
-				 * is not the last block */
-				if (!IS_LAST_BLOCK(curr) &&
-				    !GET_ALLOC(HDRP(NEXT_BLKP(curr)))) {
-					printf(
-					    "Next free block not coalesced\n");
-				}
-			}
-			curr = curr->next;
+/*
+ * Requires:
+ *   "marked[i]" is the number of blocks that mm_checkheap marked on free
+ *   list "i", walking it from its head.
+ *
+ * Effects:
+ *   Clear the marks left on the blocks of the free lists and the side index
+ *   when mm_checkheap could not walk the whole heap.
+ */
+static void
+clear_marks(const size_t *marked)
+{
+	struct side_index *si;
+	free_ptr curr;
+	char *bp;
+
+	for (int i = 0; i < config.num_classes; i++) {
+		curr = NEXT_FREE(&fb_list[i]);
+		for (size_t n = 0; n < marked[i]; n++) {
+			PUT(HDRP(curr), GET(HDRP(curr)) & ~MARK);
+			curr = NEXT_FREE(curr);
+		}
+	}
+	for (int i = 0; config.side_index && i < config.num_classes; i++) {
+		si = &side[i];
+		if (si->count > si->cap)
+			continue;
+		for (uint32_t j = 0; j < si->count; j++) {
+			bp = si->blocks[j];
+			if (si->sizes[j] != 0 && inheap(bp))
+				PUT(HDRP(bp), GET(HDRP(bp)) & ~MARK);
 		}
 	}
 }
@@ -562,19 +1302,16 @@ printblock(void *bp)
 	size_t hsize, fsize;
 	bool halloc, falloc;
 
-	checkheap(false);
 	hsize = GET_SIZE(HDRP(bp));
 	halloc = GET_ALLOC(HDRP(bp));
-	fsize = GET_SIZE(FTRP(bp));
-	falloc = GET_ALLOC(FTRP(bp));
 
 	if (hsize == 0) {
-
 		printf("%p: end of heap\n", bp);
-
 		return;
 	}
 
+	fsize = GET_SIZE(FTRP(bp));
+	falloc = GET_ALLOC(FTRP(bp));
 	printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp, hsize,
 	    (halloc ? 'a' : 'f'), fsize, (falloc ? 'a' : 'f'));
 }
@@ -584,7 +1321,8 @@ printblock(void *bp)
  *   bp - Pointer to the free block we're adding to the linked list
  *
  * Effects:
- *   Adds bp to the end of the linked list
+ *   Adds bp to the end of the linked list, or with config.addr_order, in
+ *   front of the first block of the list at a higher address
  */
 static void
 insert_node(void *bp)
@@ -593,12 +1331,155 @@ insert_node(void *bp)
 	int classIdx = GET_INDEX(size);
 	free_ptr head = &fb_list[classIdx];
 	free_ptr new_block = bp;
+	struct side_index *si = &side[classIdx];
+
+	/* Append the block to the side index, making room if need be */
+	if (config.side_index) {
+		if (si->count == si->cap && si->live <= si->cap / 2)
+			side_pack(si);
+		if (si->count < si->cap || side_grow(classIdx)) {
+			si->sizes[si->count] = MIN(size, UINT32_MAX);
+			si->blocks[si->count] = bp;
+			SLOT(bp) = si->count++;
+			si->live++;
+			return;
+		}
+		side_to_lists();
+	}
+
+	/* Insert new node at the end of the linked list, or in order */
+	if (config.addr_order) {
+		head = addr_next(bp, classIdx);
+		HINT(classIdx, REGION(bp)) = new_block;
+	}
+	SET_NEXT_FREE(new_block, head);
+	SET_PREV_FREE(new_block, PREV_FREE(head));
+	SET_NEXT_FREE(PREV_FREE(head), new_block);
+	SET_PREV_FREE(head, new_block);
+}
+
+/*
+ * Requires:
+ *   "bp" is a free block of class "cls" that is not on a free list.  The
+ *   free lists are in address order.
+ *
+ * Effects:
+ *   Returns the first block of free list "cls" at a higher address than
+ *   "bp", or the list head if there is none.  Unless "bp" belongs at either
+ *   end of the list, the walk to its place starts from the hint for the
+ *   region of "bp", or else for the nearest region within HINT_SPAN of it,
+ *   so it passes over few blocks.  Failing that, the list is walked from
+ *   both ends at once.
+ */
+static free_ptr
+addr_next(void *bp, int cls)
+{
+	free_ptr head = &fb_list[cls], lo, hi, h = NULL;
+	uintptr_t region = REGION(bp), r;
+
+	lo = NEXT_FREE(head);
+	hi = PREV_FREE(head);
+	if (lo == head || (char *)hi < (char *)bp)
+		return (head);
+	if ((char *)lo > (char *)bp)
+		return (lo);
+
+	/* Look at regions region, region - 1, region + 1, region - 2, ... */
+	for (int i = 0; h == NULL && i <= 2 * HINT_SPAN; i++) {
+		r = (i & 1) ? region - (i + 1) / 2 : region + i / 2;
+		if ((h = HINT(cls, r)) != NULL && REGION(h) != r)
+			h = NULL;
+	}
+	if (h != NULL && (char *)h < (char *)bp) {
+		while (NEXT_FREE(h) != head &&
+		    (char *)NEXT_FREE(h) < (char *)bp)
+			h = NEXT_FREE(h);
+		return (NEXT_FREE(h));
+	}
+	if (h != NULL) {
+		while (PREV_FREE(h) != head &&
+		    (char *)PREV_FREE(h) > (char *)bp)
+			h = PREV_FREE(h);
+		return (h);
+	}
+
+	while (lo != head && (char *)lo < (char *)bp &&
+	    (char *)hi > (char *)bp) {
+		lo = NEXT_FREE(lo);
+		hi = PREV_FREE(hi);
+	}
+	return ((lo == head || (char *)lo > (char *)bp) ? lo : NEXT_FREE(hi));
+}
+
+/*
+ * Requires:
+ *   "bp" is on a free list that is in address order, and "repl" is either
+ *   "bp" or the block that takes its place in the list.
+ *
+ * Effects:
+ *   If the hint for the region of "bp" is "bp", make it "repl", or else the
+ *   block that follows or precedes "bp" in the list, whichever is first
+ *   found in the same region, or clear it if none is.
+ */
+static void
+unhint(free_ptr bp, free_ptr repl)
+{
+	int cls = GET_INDEX(GET_SIZE(HDRP(bp)));
+	free_ptr head = &fb_list[cls], *h = &HINT(cls, REGION(bp));
+	free_ptr cand[3] = { repl, NEXT_FREE(bp), PREV_FREE(bp) };
+
+	if (*h != bp)
+		return;
+	*h = NULL;
+	for (int i = 0; i < 3; i++)
+		if (cand[i] != bp && cand[i] != head &&
+		    REGION(cand[i]) == REGION(bp)) {
+			*h = cand[i];
+			break;
+		}
+}
 
-	/* Insert new node at the end of the linked list */
-	new_block->next = head;
-	new_block->prev = head->prev;
-	head->prev->next = new_block;
-	head->prev = new_block;
+/*
+ * Requires:
+ *   The free lists are in address order.
+ *
+ * Effects:
+ *   Map the hint table the first time, with as many slots per class as fit
+ *   in a page, and after that double it in place with mem_remap until it
+ *   has a slot for each region that the heap could fill, or HINT_SLOTS.
+ *   A table that changes size is refilled from the free lists.  Returns
+ *   false only if no table could be mapped at all; a table that cannot
+ *   grow is kept, since regions that share a slot only find their hints
+ *   less often.
+ */
+static bool
+hint_grow(void)
+{
+	size_t want = mem_heapsize() >> HINT_SHIFT, slots = hint_slots;
+	size_t slot_bytes = config.num_classes * sizeof(free_ptr);
+	free_ptr *map, head, bp;
+
+	if (slots == 0)
+		for (slots = 1; slots < HINT_SLOTS &&
+		     2 * slots * slot_bytes <= mem_pagesize(); slots *= 2)
+			;
+	while (slots < want && slots < HINT_SLOTS)
+		slots *= 2;
+	if (slots == hint_slots)
+		return (true);
+	map = (addr_hint == NULL) ? mem_map(slots * slot_bytes) :
+	    mem_remap(addr_hint, hint_slots * slot_bytes, slots * slot_bytes);
+	if (map == (void *)-1)
+		return (addr_hint != NULL);
+	addr_hint = map;
+	hint_slots = slots;
+	memset(addr_hint, 0, slots * slot_bytes);
+	for (int i = 0; i < config.num_classes; i++) {
+		head = &fb_list[i];
+		for (bp = NEXT_FREE(head); bp != head; bp = NEXT_FREE(bp))
+			HINT(i, REGION(bp)) = bp;
+	}
+	return (true);
 }
 
 /*
@@ -612,16 +1493,259 @@ static void
 remove_node(void *bp)
 {
 	free_ptr remove_block = bp;
+	struct side_index *si;
+	uint32_t slot;
+
+	/* Empty the block's slot in the side index */
+	if (config.side_index) {
+		si = &side[GET_INDEX(GET_SIZE(HDRP(bp)))];
+		slot = SLOT(bp);
+		si->sizes[slot] = 0;
+		if (--si->live == 0)
+			si->head = si->count = 0;
+		else if (slot == si->head)
+			while (si->sizes[si->head] == 0)
+				si->head++;
+		return;
+	}
 
-	if (!remove_block || !remove_block->next || !remove_block->prev) {
+	if (!remove_block || remove_block->next == NIL ||
+	    remove_block->prev == NIL) {
 		return;
 	}
 	
 	// Set pointers to skip remove_block
 	else {
-		remove_block->next->prev = remove_block->prev;
-		remove_block->prev->next = remove_block->next;
-		remove_block->prev = NULL;
-		remove_block->next = NULL;
+		/* A hint to the block moves to a neighbour, if any */
+		if (config.addr_order)
+			unhint(remove_block, remove_block);
+
+		SET_PREV_FREE(NEXT_FREE(remove_block), PREV_FREE(remove_block));
+		SET_NEXT_FREE(PREV_FREE(remove_block), NEXT_FREE(remove_block));
+		remove_block->prev = NIL;
+		remove_block->next = NIL;
+	}
+}
+
+/*
+ * Requires:
+ *   "cls" is a size class, or -1 to create the side index.
+ *
+ * Effects:
+ *   Grow the side index's segment to give class "cls" twice the room (or
+ *   map it with SIDE_MIN_CAP in every class), and move the arrays to
+ *   their new places in it.  Returns false, leaving the index as it was,
+ *   if the segment cannot grow.
+ */
+static bool
+side_grow(int cls)
+{
+	uint32_t cap[MM_MAX_CLASSES];
+	size_t len = 0, off;
+	char *map;
+	int i;
+
+	for (i = 0; i < config.num_classes; i++) {
+		cap[i] = (cls < 0) ? SIDE_MIN_CAP : side[i].cap;
+		if (i == cls)
+			cap[i] *= 2;
+		len += cap[i] * SIDE_ENTRY;
+	}
+	map = (cls < 0) ? mem_map(len) : mem_remap(side_map, side_len, len);
+	if (map == (void *)-1)
+		return (false);
+
+	/*
+	 * Every array moves up or stays, so move them from the last down,
+	 * each to where the ones after it were.  The size arrays come
+	 * first, so that they stay 32-byte aligned.
+	 */
+	off = len;
+	for (i = config.num_classes - 1; i >= 0; i--) {
+		off -= cap[i] * sizeof(char *);
+		if (side[i].count > 0)
+			memmove(map + off,
+			    map + ((char *)side[i].blocks - side_map),
+			    side[i].count * sizeof(char *));
+		side[i].blocks = (char **)(map + off);
+	}
+	for (i = config.num_classes - 1; i >= 0; i--) {
+		off -= cap[i] * sizeof(uint32_t);
+		if (side[i].count > 0)
+			memmove(map + off,
+			    map + ((char *)side[i].sizes - side_map),
+			    side[i].count * sizeof(uint32_t));
+		side[i].sizes = (uint32_t *)(map + off);
+		side[i].cap = cap[i];
+	}
+	side_map = map;
+	side_len = len;
+	return (true);
+}
+
+/*
+ * Requires:
+ *   "si" is the side index of a class that is full.
+ *
+ * Effects:
+ *   Move the live slots of "si" to the front, in order.
+ */
+static void
+side_pack(struct side_index *si)
+{
+	uint32_t i, n = 0;
+
+	for (i = si->head; i < si->count; i++) {
+		if (si->sizes[i] == 0)
+			continue;
+		si->sizes[n] = si->sizes[i];
+		si->blocks[n] = si->blocks[i];
+		SLOT(si->blocks[n]) = n;
+		n++;
+	}
+	si->head = 0;
+	si->count = n;
+}
+
+/*
+ * Requires:
+ *   "cls" is a size class and the side index is in use.
+ *
+ * Effects:
+ *   Find a fit for a block with "asize" bytes in class "cls" of the side
+ *   index, reading only its size array until it finds one.  Like find_fit
+ *   in a free list, it passes over at most config.fit_threshold + 1
+ *   blocks; the slots of removed blocks do not count.  Returns that
+ *   block's address or NULL if no suitable block was found.
+ */
+static void *
+side_find(int cls, size_t asize)
+{
+	struct side_index *si = &side[cls];
+	uint32_t want = MIN(asize, UINT32_MAX), i, j, end, left = UINT32_MAX;
+
+	if (config.fit_threshold >= 0 &&
+	    (uint32_t)config.fit_threshold < si->live)
+		left = config.fit_threshold + 1;
+
+	/*
+	 * Scan as many slots as there are blocks left to pass over, then
+	 * take the live ones among them off the count.  Without a bound
+	 * that matters, that is every slot at once.
+	 */
+	for (i = si->head; left > 0 && i < si->count; i = end) {
+		end = (si->count - i > left) ? i + left : si->count;
+		for (j = i; (j += first_fit(si->sizes + j, end - j, want)) <
+		     end; j++)
+			if (want < UINT32_MAX ||
+			    GET_SIZE(HDRP(si->blocks[j])) >= asize)
+				return (si->blocks[j]);
+		if (end == si->count)
+			break;
+		for (j = i; j < end; j++)
+			left -= (si->sizes[j] != 0);
 	}
+	return (NULL);
+}
+
+/*
+ * The first_fit_* kernels all have the same contract.
+ *
+ * Requires:
+ *   "sizes" points to "n" entries of a side index size array and "want"
+ *   is not 0.
+ *
+ * Effects:
+ *   Returns the index of the first entry that is at least "want", or "n"
+ *   if there is none.  The vector kernels compare 8 (AVX2) or 4 (SSE2,
+ *   NEON) entries per instruction and leave the tail to the scalar one.
+ */
+static uint32_t
+first_fit_scalar(const uint32_t *sizes, uint32_t n, uint32_t want)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		if (sizes[i] >= want)
+			break;
+	return (i);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static uint32_t
+first_fit_avx2(const uint32_t *sizes, uint32_t n, uint32_t want)
+{
+	__m256i w = _mm256_set1_epi32(want), x;
+	uint32_t i, mask;
+
+	/* x >= w exactly when max(x, w) == x, unsigned */
+	for (i = 0; i + 8 <= n; i += 8) {
+		x = _mm256_loadu_si256((const __m256i *)(sizes + i));
+		x = _mm256_cmpeq_epi32(_mm256_max_epu32(x, w), x);
+		mask = _mm256_movemask_ps(_mm256_castsi256_ps(x));
+		if (mask != 0)
+			return (i + __builtin_ctz(mask));
+	}
+	return (i + first_fit_scalar(sizes + i, n - i, want));
+}
+#endif
+
+#ifdef __SSE2__
+static uint32_t
+first_fit_sse2(const uint32_t *sizes, uint32_t n, uint32_t want)
+{
+	/* SSE2 compares only signed words, so flip the sign bits first */
+	__m128i bias = _mm_set1_epi32(INT32_MIN);
+	__m128i w = _mm_xor_si128(_mm_set1_epi32(want - 1), bias), x;
+	uint32_t i, mask;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm_loadu_si128((const __m128i *)(sizes + i));
+		x = _mm_cmpgt_epi32(_mm_xor_si128(x, bias), w);
+		mask = _mm_movemask_ps(_mm_castsi128_ps(x));
+		if (mask != 0)
+			return (i + __builtin_ctz(mask));
+	}
+	return (i + first_fit_scalar(sizes + i, n - i, want));
+}
+#endif
+
+#ifdef __aarch64__
+static uint32_t
+first_fit_neon(const uint32_t *sizes, uint32_t n, uint32_t want)
+{
+	uint32x4_t w = vdupq_n_u32(want);
+	uint32_t i;
+
+	/* Find the first group of 4 with a fit, then the fit within it */
+	for (i = 0; i + 4 <= n; i += 4)
+		if (vmaxvq_u32(vcgeq_u32(vld1q_u32(sizes + i), w)) != 0)
+			break;
+	return (i + first_fit_scalar(sizes + i, n - i, want));
+}
+#endif
+
+/*
+ * Requires:
+ *   The side index is in use.
+ *
+ * Effects:
+ *   Link every block of the side index into the free lists, and stop
+ *   using the index, for when it cannot grow.
+ */
+static void
+side_to_lists(void)
+{
+	int i;
+
+	fprintf(stderr, "mm: cannot grow the side index; using lists\n");
+	config.side_index = 0;
+	for (i = 0; i < config.num_classes; i++)
+		for (uint32_t j = side[i].head; j < side[i].count; j++)
+			if (side[i].sizes[j] != 0)
+				insert_node(side[i].blocks[j]);
+	if (side_map != NULL)
+		mem_unmap(side_map, side_len);
+	side_map = NULL;
+	memset(side, 0, sizeof(side));
 }
@@ -1,3 +1,6 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 /*
  * The public interface to the students' memory allocator.
  */
@@ -7,6 +10,45 @@ void *mm_malloc(size_t size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * Heap inspection for the driver's profiles.  mm_heapwalk calls visit for
+ * every block of the heap in address order with the address of the
+ * block's first byte (its header, not its payload), its size including
+ * overhead, whether it is allocated, and the size class of the free list
+ * that it is on (-1 if it is allocated).
+ */
+typedef void (*mm_visit_t)(void *blk, size_t size, int alloc, int cls,
+    void *arg);
+void mm_heapwalk(mm_visit_t visit, void *arg);
+
+/*
+ * The allocator's policy.  mm_init starts each heap with the policy given
+ * by the last call to mm_set_config, or else by the MM_FIT_THRESHOLD,
+ * MM_NUM_CLASSES, MM_CHUNKSIZE, MM_SPLIT_MIN, MM_SIDE_INDEX and
+ * MM_ADDR_ORDER environment variables, or else by the defaults (16, 15,
+ * 4096, 32, 0 and 0).
+ */
+#define MM_MAX_CLASSES 32
+
+typedef struct {
+	int fit_threshold; /* blocks find_fit passes over per class; -1: all
+			      (always all with addr_order) */
+	int num_classes;   /* segregated free lists, 1..MM_MAX_CLASSES */
+	size_t chunksize;  /* least bytes the heap grows by */
+	size_t split_min;  /* least remainder that place() splits off */
+	int side_index;	   /* 1: find_fit scans per-class size arrays */
+	int addr_order;	   /* 1: free lists are in address order */
+} mm_config_t;
+
+void mm_get_config(mm_config_t *config);
+int mm_set_config(const mm_config_t *config);
+
+/*
+ * Heap consistency checker.  Returns the number of problems found, after
+ * printing each of them, and prints every block if verbose is nonzero.
+ */
+int mm_checkheap(int verbose);
+
 /*
  * Students work in teams of one or two.  Teams enter their team name, personal
  * names and login IDs in a struct of this type in their mm.c file.
@@ -20,3 +62,5 @@ typedef struct {
 } team_t;
 
 extern team_t team;
+
+#endif /* __MM_H_ */
@@ -0,0 +1,396 @@
+/*
+ * mm_implicit.c - The baseline allocator of the CS:APP3e text: an implicit
+ * free list, first fit placement, and boundary tag coalescing.  Blocks are
+ * aligned to double-word boundaries and the minimum block size is four
+ * words.
+ *
+ * mdriver runs it as the "implicit" engine (-e), as a point of comparison
+ * for the segregated fits allocator in mm.c.  Every search walks the whole
+ * heap, allocated blocks included, so it is slow but its placement is easy
+ * to reason about.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "memlib.h"
+
+/* Basic constants and macros: */
+#define WSIZE	  sizeof(void *) /* Word and header/footer size (bytes) */
+#define DSIZE	  (2 * WSIZE)	 /* Doubleword size (bytes) */
+#define CHUNKSIZE (1 << 12)	 /* Extend heap by this amount (bytes) */
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* Pack a size and allocated bit into a word. */
+#define PACK(size, alloc) ((size) | (alloc))
+
+/* Read and write a word at address p. */
+#define GET(p)	    (*(uintptr_t *)(p))
+#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+
+/* Read the size and allocated fields from address p. */
+#define GET_SIZE(p)  (GET(p) & ~(DSIZE - 1))
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Given block ptr bp, compute address of its header and footer. */
+#define HDRP(bp) ((char *)(bp)-WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given block ptr bp, compute address of next and previous blocks. */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
+#define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE)))
+
+/* Global variables: */
+static char *heap_listp; /* Pointer to first block */
+
+/* Function prototypes for the entry points: */
+static int implicit_init(void);
+static void *implicit_malloc(size_t size);
+static void implicit_free(void *bp);
+static void *implicit_realloc(void *ptr, size_t size);
+static int implicit_checkheap(int verbose);
+static void implicit_heapwalk(mm_visit_t visit, void *arg);
+
+/* Function prototypes for internal helper routines: */
+static void *coalesce(void *bp);
+static void *extend_heap(size_t words);
+static void *find_fit(size_t asize);
+static void place(void *bp, size_t asize);
+
+const engine_t implicit_engine = { "implicit",
+	"implicit free list, first fit (mm_implicit.c)", implicit_init,
+	implicit_malloc, implicit_free, implicit_realloc, implicit_checkheap,
+	implicit_heapwalk, 1 };
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Initialize the memory manager.  Returns 0 if the memory manager was
+ *   successfully initialized and -1 otherwise.
+ */
+static int
+implicit_init(void)
+{
+	/* Create the initial empty heap. */
+	if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+		return (-1);
+	PUT(heap_listp, 0);			       /* Alignment padding */
+	PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
+	PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
+	PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
+	heap_listp += (2 * WSIZE);
+
+	/* Extend the empty heap with a free block of CHUNKSIZE bytes. */
+	if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+		return (-1);
+	return (0);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Allocate a block with at least "size" bytes of payload, unless "size" is
+ *   zero.  Returns the address of this block if the allocation was successful
+ *   and NULL otherwise.
+ */
+static void *
+implicit_malloc(size_t size)
+{
+	size_t asize;	   /* Adjusted block size */
+	size_t extendsize; /* Amount to extend heap if no fit */
+	void *bp;
+
+	/* Ignore spurious requests. */
+	if (size == 0)
+		return (NULL);
+
+	/* Adjust block size to include overhead and alignment reqs. */
+	if (size <= DSIZE)
+		asize = 2 * DSIZE;
+	else
+		asize = DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
+
+	/* Search the free list for a fit. */
+	if ((bp = find_fit(asize)) != NULL) {
+		place(bp, asize);
+		return (bp);
+	}
+
+	/* No fit found.  Get more memory and place the block. */
+	extendsize = MAX(asize, CHUNKSIZE);
+	if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+		return (NULL);
+	place(bp, asize);
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   "bp" is either the address of an allocated block or NULL.
+ *
+ * Effects:
+ *   Free a block.
+ */
+static void
+implicit_free(void *bp)
+{
+	size_t size;
+
+	/* Ignore spurious requests. */
+	if (bp == NULL)
+		return;
+
+	/* Free and coalesce the block. */
+	size = GET_SIZE(HDRP(bp));
+	PUT(HDRP(bp), PACK(size, 0));
+	PUT(FTRP(bp), PACK(size, 0));
+	coalesce(bp);
+}
+
+/*
+ * Requires:
+ *   "ptr" is either the address of an allocated block or NULL.
+ *
+ * Effects:
+ *   Reallocates the block "ptr" to a block with at least "size" bytes of
+ *   payload, unless "size" is zero.  If "size" is zero, frees the block
+ *   "ptr" and returns NULL.  Otherwise, a new block is allocated and the
+ *   contents of the old block "ptr" are copied to that new block.  Returns
+ *   the address of this new block if the allocation was successful and
+ *   NULL otherwise.
+ */
+static void *
+implicit_realloc(void *ptr, size_t size)
+{
+	size_t oldsize;
+	void *newptr;
+
+	/* If size == 0 then this is just free, and we return NULL. */
+	if (size == 0) {
+		implicit_free(ptr);
+		return (NULL);
+	}
+
+	/* If oldptr is NULL, then this is just malloc. */
+	if (ptr == NULL)
+		return (implicit_malloc(size));
+
+	newptr = implicit_malloc(size);
+
+	/* If realloc() fails the original block is left untouched  */
+	if (newptr == NULL)
+		return (NULL);
+
+	/* Copy just the old data, not the old header and footer. */
+	oldsize = GET_SIZE(HDRP(ptr)) - DSIZE;
+	if (size < oldsize)
+		oldsize = size;
+	memcpy(newptr, ptr, oldsize);
+
+	/* Free the old block. */
+	implicit_free(ptr);
+
+	return (newptr);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Check the heap for consistency, printing a line for each problem found,
+ *   and return the number of problems.  Prints every block if "verbose" is
+ *   nonzero.
+ */
+static int
+implicit_checkheap(int verbose)
+{
+	char *bp, *end = (char *)mem_heap_hi() + 1;
+	bool prev_free = false;
+	int errors = 0;
+
+	if (GET_SIZE(HDRP(heap_listp)) != DSIZE || !GET_ALLOC(HDRP(heap_listp))) {
+		printf("Error: bad prologue header\n");
+		errors++;
+	}
+	for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0;
+	     bp = NEXT_BLKP(bp)) {
+		if (verbose)
+			printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp,
+			    (size_t)GET_SIZE(HDRP(bp)),
+			    GET_ALLOC(HDRP(bp)) ? 'a' : 'f',
+			    (size_t)GET_SIZE(FTRP(bp)),
+			    GET_ALLOC(FTRP(bp)) ? 'a' : 'f');
+		if ((char *)bp + GET_SIZE(HDRP(bp)) > end) {
+			printf("Error: %p has a bad size %zu\n", bp,
+			    (size_t)GET_SIZE(HDRP(bp)));
+			return (errors + 1);
+		}
+		if ((uintptr_t)bp % DSIZE) {
+			printf("Error: %p is not doubleword aligned\n", bp);
+			errors++;
+		}
+		if (GET(HDRP(bp)) != GET(FTRP(bp))) {
+			printf("Error: header of %p does not match footer\n",
+			    bp);
+			errors++;
+		}
+		if (prev_free && !GET_ALLOC(HDRP(bp))) {
+			printf("Error: free block %p was not coalesced with "
+			       "the block before it\n", bp);
+			errors++;
+		}
+		prev_free = !GET_ALLOC(HDRP(bp));
+	}
+	if (!GET_ALLOC(HDRP(bp)) || HDRP(bp) != end - WSIZE) {
+		printf("Error: bad epilogue header at %p\n", HDRP(bp));
+		errors++;
+	}
+	return (errors);
+}
+
+/*
+ * Requires:
+ *   "visit" is a function that does not change the heap.
+ *
+ * Effects:
+ *   Calls "visit" for every block between the prologue and the epilogue,
+ *   in address order, passing "arg" along.  There are no free lists, so
+ *   every free block is reported in class 0.
+ */
+static void
+implicit_heapwalk(mm_visit_t visit, void *arg)
+{
+	char *bp;
+	size_t size;
+	bool alloc;
+
+	for (bp = NEXT_BLKP(heap_listp); (size = GET_SIZE(HDRP(bp))) > 0;
+	     bp = NEXT_BLKP(bp)) {
+		alloc = GET_ALLOC(HDRP(bp));
+		visit(HDRP(bp), size, alloc, alloc ? -1 : 0, arg);
+	}
+}
+
+/*
+ * The following routines are internal helper routines.
+ */
+
+/*
+ * Requires:
+ *   "bp" is the address of a newly freed block.
+ *
+ * Effects:
+ *   Perform boundary tag coalescing.  Returns the address of the coalesced
+ *   block.
+ */
+static void *
+coalesce(void *bp)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+	bool prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+	bool next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+
+	if (prev_alloc && next_alloc) { /* Case 1 */
+		return (bp);
+	} else if (prev_alloc && !next_alloc) { /* Case 2 */
+		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+		PUT(HDRP(bp), PACK(size, 0));
+		PUT(FTRP(bp), PACK(size, 0));
+	} else if (!prev_alloc && next_alloc) { /* Case 3 */
+		size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+		PUT(FTRP(bp), PACK(size, 0));
+		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+		bp = PREV_BLKP(bp);
+	} else { /* Case 4 */
+		size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+		    GET_SIZE(FTRP(NEXT_BLKP(bp)));
+		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+		PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+		bp = PREV_BLKP(bp);
+	}
+	return (bp);
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Extend the heap with a free block and return that block's address.
+ */
+static void *
+extend_heap(size_t words)
+{
+	size_t size;
+	void *bp;
+
+	/* Allocate an even number of words to maintain alignment. */
+	size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+		return (NULL);
+
+	/* Initialize free block header/footer and the epilogue header. */
+	PUT(HDRP(bp), PACK(size, 0));	      /* Free block header */
+	PUT(FTRP(bp), PACK(size, 0));	      /* Free block footer */
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+
+	/* Coalesce if the previous block was free. */
+	return (coalesce(bp));
+}
+
+/*
+ * Requires:
+ *   None.
+ *
+ * Effects:
+ *   Find a fit for a block with "asize" bytes.  Returns that block's address
+ *   or NULL if no suitable block was found.
+ */
+static void *
+find_fit(size_t asize)
+{
+	void *bp;
+
+	/* Search for the first fit. */
+	for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+		if (!GET_ALLOC(HDRP(bp)) && asize <= GET_SIZE(HDRP(bp)))
+			return (bp);
+	}
+	/* No fit was found. */
+	return (NULL);
+}
+
+/*
+ * Requires:
+ *   "bp" is the address of a free block that is at least "asize" bytes.
+ *
+ * Effects:
+ *   Place a block of "asize" bytes at the start of the free block "bp" and
+ *   split that block if the remainder would be at least the minimum block
+ *   size.
+ */
+static void
+place(void *bp, size_t asize)
+{
+	size_t csize = GET_SIZE(HDRP(bp));
+
+	if ((csize - asize) >= (2 * DSIZE)) {
+		PUT(HDRP(bp), PACK(asize, 1));
+		PUT(FTRP(bp), PACK(asize, 1));
+		bp = NEXT_BLKP(bp);
+		PUT(HDRP(bp), PACK(csize - asize, 0));
+		PUT(FTRP(bp), PACK(csize - asize, 0));
+	} else {
+		PUT(HDRP(bp), PACK(csize, 1));
+		PUT(FTRP(bp), PACK(csize, 1));
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ * perfctr.c - Hardware performance counters (Linux perf_event_open)
+ *
+ * Each event is opened on its own rather than as a group, so that the
+ * events that the PMU cannot count at the same time are multiplexed and
+ * scaled instead of not being counted at all.  On systems without
+ * perf_event_open, or where it is not permitted, no event is available.
+ */
+#include <string.h>
+#include <unistd.h>
+
+#include "perfctr.h"
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include <linux/perf_event.h>
+
+/* Build the config of a generic cache event that counts read misses */
+#define CACHE_MISS(cache)                                               \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                 \
+	    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} events[PERFCTR_NEVENTS] = {
+	[PC_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PC_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PC_L1D_MISSES] = { PERF_TYPE_HW_CACHE,
+	    CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+	[PC_LLC_MISSES] = { PERF_TYPE_HW_CACHE,
+	    CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+	[PC_DTLB_MISSES] = { PERF_TYPE_HW_CACHE,
+	    CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+	[PC_BRANCH_MISSES] = { PERF_TYPE_HARDWARE,
+	    PERF_COUNT_HW_BRANCH_MISSES },
+};
+#endif
+
+const char *perfctr_names[PERFCTR_NEVENTS] = {
+	[PC_INSTRUCTIONS] = "inst",
+	[PC_CYCLES] = "cyc",
+	[PC_L1D_MISSES] = "L1D",
+	[PC_LLC_MISSES] = "LLC",
+	[PC_DTLB_MISSES] = "dTLB",
+	[PC_BRANCH_MISSES] = "brmiss",
+};
+
+/*
+ * read_event - Read the count and the enabled and running times of an
+ *     event.  Returns -1 if the event cannot be read.
+ */
+static int
+read_event(int fd, uint64_t val[3])
+{
+	return (read(fd, val, 3 * sizeof(uint64_t)) ==
+		   3 * sizeof(uint64_t)) ?
+	    0 :
+	    -1;
+}
+
+/*
+ * perfctr_open - Open a disabled counter for each event.  Returns the
+ *     number of events that can be counted on this system.
+ */
+int
+perfctr_open(perfctr_t *pc)
+{
+	int i, n = 0;
+
+	for (i = 0; i < PERFCTR_NEVENTS; i++) {
+		pc->fds[i] = -1;
+		pc->counts[i] = -1;
+	}
+#if defined(__linux__)
+	for (i = 0; i < PERFCTR_NEVENTS; i++) {
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+		    PERF_FORMAT_TOTAL_TIME_RUNNING;
+		pc->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (pc->fds[i] >= 0)
+			n++;
+	}
+#endif
+	return n;
+}
+
+/*
+ * perfctr_begin - Record the current readings, against which
+ *     perfctr_end() measures
+ */
+void
+perfctr_begin(perfctr_t *pc)
+{
+	int i;
+
+	for (i = 0; i < PERFCTR_NEVENTS; i++) {
+		if (pc->fds[i] >= 0 && read_event(pc->fds[i], pc->base[i]) < 0)
+			pc->base[i][0] = pc->base[i][1] = pc->base[i][2] = 0;
+	}
+}
+
+/*
+ * perfctr_enable - Start every counter of the calling thread with one
+ *     system call, which keeps the cost inside the measured region small.
+ */
+void
+perfctr_enable(void)
+{
+#if defined(__linux__)
+	prctl(PR_TASK_PERF_EVENTS_ENABLE);
+#endif
+}
+
+/*
+ * perfctr_disable - Stop every counter of the calling thread
+ */
+void
+perfctr_disable(void)
+{
+#if defined(__linux__)
+	prctl(PR_TASK_PERF_EVENTS_DISABLE);
+#endif
+}
+
+/*
+ * perfctr_end - Set pc->counts to the average number of events per run
+ *     since perfctr_begin().  An event that was multiplexed is scaled up
+ *     by the fraction of the time it was actually counted.  Events that
+ *     are unavailable or were never scheduled are left at -1.
+ */
+void
+perfctr_end(perfctr_t *pc, int runs)
+{
+	uint64_t now[3];
+	double value, enabled, running;
+	int i;
+
+	for (i = 0; i < PERFCTR_NEVENTS; i++) {
+		pc->counts[i] = -1;
+		if (pc->fds[i] < 0 || runs <= 0 ||
+		    read_event(pc->fds[i], now) < 0)
+			continue;
+		value = now[0] - pc->base[i][0];
+		enabled = now[1] - pc->base[i][1];
+		running = now[2] - pc->base[i][2];
+		if (running > 0)
+			pc->counts[i] = value * (enabled / running) / runs;
+	}
+}
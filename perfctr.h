@@ -0,0 +1,46 @@
+/*
+ * perfctr.h - Hardware performance counters (Linux perf_event_open)
+ *
+ * The counters count user-mode events of the calling thread only while
+ * they are enabled, so a caller can bracket just the code it is
+ * measuring with perfctr_enable() and perfctr_disable().
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+#include <stdint.h>
+
+/* The events that are counted */
+enum {
+	PC_INSTRUCTIONS,
+	PC_CYCLES,
+	PC_L1D_MISSES,
+	PC_LLC_MISSES,
+	PC_DTLB_MISSES,
+	PC_BRANCH_MISSES,
+	PERFCTR_NEVENTS
+};
+
+typedef struct {
+	int fds[PERFCTR_NEVENTS];	   /* -1 if the event is unavailable */
+	uint64_t base[PERFCTR_NEVENTS][3]; /* readings at perfctr_begin() */
+	double counts[PERFCTR_NEVENTS];	   /* per run, or -1 if unavailable */
+} perfctr_t;
+
+/* Short names of the events, for column headings */
+extern const char *perfctr_names[PERFCTR_NEVENTS];
+
+/* Open the counters; returns the number that are available */
+int perfctr_open(perfctr_t *pc);
+
+/* Start a measurement of one or more runs */
+void perfctr_begin(perfctr_t *pc);
+
+/* Enable and disable every counter of this thread at once */
+void perfctr_enable(void);
+void perfctr_disable(void);
+
+/* End a measurement, leaving the average count per run in pc->counts */
+void perfctr_end(perfctr_t *pc, int runs);
+
+#endif /* __PERFCTR_H_ */
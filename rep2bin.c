@@ -0,0 +1,138 @@
+/*
+ * rep2bin.c - Convert a text .rep trace file into the binary trace
+ *     format described in bintrace.h.
+ *
+ * Usage: rep2bin <in.rep> <out.bin>
+ *
+ * The driver can mmap() the resulting file and replay it in place, so
+ * large traces need only be parsed once, here.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bintrace.h"
+
+#define MAXLINE	  1024 /* max string size */
+#define BATCH_OPS 4096 /* records buffered before each fwrite() */
+
+static const char *out_path; /* the output file, once it exists */
+
+/*
+ * The header is written last, so a half-written output file has a zero
+ * header that the driver would read as a text trace.  Remove it.
+ */
+static void
+remove_output(void)
+{
+	if (out_path != NULL)
+		remove(out_path);
+}
+
+static void
+unix_error(const char *msg, const char *path)
+{
+	fprintf(stderr, "rep2bin: %s %s: %s\n", msg, path, strerror(errno));
+	remove_output();
+	exit(1);
+}
+
+static void
+app_error(const char *msg, const char *path)
+{
+	fprintf(stderr, "rep2bin: %s: %s\n", path, msg);
+	remove_output();
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *in, *out;
+	bintrace_hdr_t hdr;
+	static traceop_t batch[BATCH_OPS];
+	char type[MAXLINE];
+	unsigned long long index, size;
+	unsigned long long max_index = 0;
+	uint64_t op_index = 0;
+	int nbatch = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: rep2bin <in.rep> <out.bin>\n");
+		exit(1);
+	}
+	if ((in = fopen(argv[1], "r")) == NULL)
+		unix_error("could not open", argv[1]);
+	if ((out = fopen(argv[2], "w")) == NULL)
+		unix_error("could not create", argv[2]);
+	out_path = argv[2];
+
+	/* Read the text header; the binary header is written last. */
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BINTRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINTRACE_VERSION;
+	hdr.op_size = sizeof(traceop_t);
+	if (fscanf(in, "%" SCNu64 "%" SCNu64 "%" SCNu64 "%" SCNu64,
+		&hdr.sugg_heapsize, &hdr.num_ids, &hdr.num_ops,
+		&hdr.weight) != 4)
+		app_error("malformed trace header", argv[1]);
+	if (fseek(out, sizeof(hdr), SEEK_SET) < 0)
+		unix_error("could not seek in", argv[2]);
+
+	/* Translate every request line into a packed record. */
+	while (fscanf(in, "%s", type) != EOF) {
+		traceop_t *op = &batch[nbatch];
+
+		switch (type[0]) {
+		case 'a':
+		case 'r':
+			if (fscanf(in, "%llu %llu", &index, &size) != 2)
+				app_error("malformed request line", argv[1]);
+			op->type = (type[0] == 'a') ? ALLOC : REALLOC;
+			op->index = index;
+			op->size = size;
+			max_index = (index > max_index) ? index : max_index;
+			break;
+		case 'f':
+			if (fscanf(in, "%llu", &index) != 1)
+				app_error("malformed request line", argv[1]);
+			op->type = FREE;
+			op->index = index;
+			op->size = 0;
+			break;
+		default:
+			fprintf(stderr,
+			    "rep2bin: bogus type character (%c) in %s\n",
+			    type[0], argv[1]);
+			remove_output();
+			exit(1);
+		}
+		op_index++;
+		if (++nbatch == BATCH_OPS) {
+			if (fwrite(batch, sizeof(traceop_t), nbatch, out) !=
+			    (size_t)nbatch)
+				unix_error("write failed on", argv[2]);
+			nbatch = 0;
+		}
+	}
+	if (nbatch > 0 &&
+	    fwrite(batch, sizeof(traceop_t), nbatch, out) != (size_t)nbatch)
+		unix_error("write failed on", argv[2]);
+	fclose(in);
+
+	if (op_index != hdr.num_ops)
+		app_error("op count does not match the header", argv[1]);
+	if (op_index > 0 && max_index != hdr.num_ids - 1)
+		app_error("id count does not match the header", argv[1]);
+
+	/* Now that the body is known to be good, write the header. */
+	rewind(out);
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+		unix_error("write failed on", argv[2]);
+	if (fclose(out) != 0)
+		unix_error("close failed on", argv[2]);
+
+	return (0);
+}
@@ -0,0 +1,50 @@
+#ifndef __SNAPSHOT_H_
+#define __SNAPSHOT_H_
+
+/*
+ * snapshot.h - the binary heap snapshot format written by mdriver (-S)
+ *     and read by heapmap.
+ *
+ * A snapshot is a fixed-size header followed immediately by one packed
+ * snapshot_rec_t per block of the heap, in address order, as reported by
+ * mm_heapwalk().  Like a binary trace, it is stored in the native byte
+ * order of the machine that wrote it.
+ *
+ * Offsets are from the first block of the heap when the snapshot was
+ * written.  That moves if the heap maps a segment below it, so offsets are
+ * only comparable within one snapshot.  The span runs from the first block
+ * to the end of the last one.  A heap of several segments can span more
+ * than its heapsize, and the gaps between the segments hold no blocks.
+ * The segments that hold no blocks at all, such as an allocator's side
+ * tables, are outside the span and are not in seg_bytes.
+ */
+
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC	 "MMHEAP" /* includes the terminating NUL */
+#define SNAPSHOT_VERSION 4
+
+/* One block of the heap */
+typedef struct {
+	uint64_t offset;     /* block (header) address - start of the heap */
+	uint64_t size : 48;  /* block size, including overhead */
+	uint64_t alloc : 1;  /* set if the block is allocated */
+	uint64_t cls : 15;   /* free-list class, if the block is free */
+} snapshot_rec_t;
+
+/* The header at the start of every snapshot file */
+typedef struct {
+	char magic[8];	    /* SNAPSHOT_MAGIC */
+	uint32_t version;   /* SNAPSHOT_VERSION */
+	uint32_t rec_size;  /* sizeof(snapshot_rec_t) of the writer */
+	int32_t tracenum;   /* trace number in mdriver's tables */
+	uint32_t pad;
+	uint64_t opnum;	    /* number of requests replayed */
+	uint64_t heapsize;  /* mem_heapsize() */
+	uint64_t span;	    /* end of the last block - the first block */
+	uint64_t seg_bytes; /* bytes of the break and segments with blocks */
+	uint64_t live;	    /* payload bytes the trace has allocated */
+	uint64_t nblocks;   /* number of records that follow */
+} snapshot_hdr_t;
+
+#endif /* __SNAPSHOT_H_ */
@@ -0,0 +1,513 @@
+/*
+ * tracegen.c - Generate a synthetic trace file from a declared workload.
+ *
+ * Usage: tracegen <spec> <out.rep|out.bin>
+ *
+ * The trace is written in the text format that mdriver reads, or in the
+ * binary format of bintrace.h if the output file's name ends in ".bin".
+ * The spec file declares the workload one setting per line; "#" starts
+ * a comment.  Every block that is still live at the end is freed, so
+ * the trace is balanced.
+ *
+ *     seed <n>                    random seed (default 1)
+ *     phase <ops>                 start a phase of <ops> requests
+ *     size fixed <n>              payload sizes of new blocks
+ *     size uniform <lo> <hi>
+ *     size lognormal <mu> <sigma> (of the natural log of the size)
+ *     size pow2 <lo> <hi>         a power of two in [lo, hi]
+ *     lifetime fixed <n>          requests until a new block is freed
+ *     lifetime uniform <lo> <hi>
+ *     lifetime exp <mean>
+ *     lifetime forever            freed only at the end of the trace
+ *     realloc <prob> <factor>     fraction of requests that resize a
+ *                                 random live block by <factor>
+ *     peak <bytes>                free the blocks that would die first
+ *                                 rather than let a new block take the
+ *                                 live payload over <bytes>, and grow a
+ *                                 block no further than that with a
+ *                                 realloc (0 = no limit)
+ *
+ * Settings before the first phase are the defaults, and every phase
+ * starts with the settings of the one before it, so a phase only needs
+ * to declare what changes.  For example:
+ *
+ *     size lognormal 4 1
+ *     lifetime exp 200
+ *     phase 100000
+ *     phase 50000
+ *     size pow2 1024 65536
+ *     realloc 0.1 1.5
+ *     peak 4000000
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bintrace.h"
+
+#define MAXLINE	  1024	     /* max string size */
+#define MAXPHASES 64	     /* max phases in a spec */
+#define BATCH_OPS 4096	     /* records buffered before each fwrite() */
+#define MAX_SIZE  (1 << 30)  /* largest block that is generated */
+#define FOREVER	  UINT64_MAX /* death of a block that lives forever */
+
+/* Distributions of sizes and lifetimes */
+enum { D_FIXED, D_UNIFORM, D_LOGNORMAL, D_POW2, D_EXP, D_FOREVER };
+
+typedef struct {
+	int type;    /* D_* */
+	double a, b; /* its parameters */
+} dist_t;
+
+/* The settings of one phase of the workload */
+typedef struct {
+	uint64_t ops;	     /* requests in this phase */
+	dist_t size;	     /* sizes of new blocks */
+	dist_t lifetime;     /* lifetimes of new blocks, in requests */
+	double realloc_prob; /* fraction of requests that are reallocs */
+	double realloc_by;   /* factor by which a realloc resizes */
+	uint64_t peak;	     /* max live payload, or 0 */
+} phase_t;
+
+/* A block that will be freed at a given request */
+typedef struct {
+	uint64_t death;
+	uint64_t id;
+} death_t;
+
+static phase_t phases[MAXPHASES];
+static int nphases = 0;
+static uint64_t seed = 1;
+
+/*
+ * The live blocks, by id, and a heap of them ordered by death.  The id of
+ * a freed block is handed out again, so there are never more ids than the
+ * most blocks that were live at once.
+ */
+static uint64_t *sizes;	   /* payload size by id */
+static uint64_t *livepos;  /* index in live[] by id */
+static uint64_t *live;	   /* ids of the live blocks */
+static uint64_t nlive = 0;
+static death_t *deaths;	   /* min-heap of the live blocks' deaths */
+static uint64_t ndeaths = 0;
+static uint64_t *freeids;  /* ids of the freed blocks */
+static uint64_t nfreeids = 0;
+static uint64_t nids = 0;  /* ids handed out */
+static uint64_t maxids = 0; /* room in the arrays above */
+static uint64_t live_bytes = 0, peak_bytes = 0;
+
+/* The requests written so far */
+static FILE *body;
+static traceop_t batch[BATCH_OPS];
+static int nbatch = 0;
+static uint64_t nops = 0;
+
+static void
+unix_error(const char *msg, const char *path)
+{
+	fprintf(stderr, "tracegen: %s %s: %s\n", msg, path, strerror(errno));
+	exit(1);
+}
+
+static void
+app_error(const char *msg, const char *path, int line)
+{
+	fprintf(stderr, "tracegen: %s:%d: %s\n", path, line, msg);
+	exit(1);
+}
+
+/*
+ * next_random - Return a uniform random 64-bit number (xorshift64*), the
+ *     same on every system for a given seed
+ */
+static uint64_t
+next_random(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * uniform - Return a uniform random number in [0, 1)
+ */
+static double
+uniform(void)
+{
+	return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * draw - Draw a value from a distribution
+ */
+static uint64_t
+draw(const dist_t *d)
+{
+	double v, u1, u2;
+	int lo, hi;
+
+	switch (d->type) {
+	case D_FIXED:
+		v = d->a;
+		break;
+	case D_UNIFORM:
+		v = d->a + floor(uniform() * (d->b - d->a + 1));
+		break;
+	case D_LOGNORMAL: /* Box-Muller */
+		u1 = 1.0 - uniform();
+		u2 = uniform();
+		v = exp(d->a + d->b * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2));
+		break;
+	case D_POW2:
+		lo = (int)ceil(log2(d->a));
+		hi = (int)floor(log2(d->b));
+		v = ldexp(1, lo + (int)(uniform() * (hi - lo + 1)));
+		break;
+	case D_EXP:
+		v = -d->a * log(1.0 - uniform());
+		break;
+	default:
+		return FOREVER;
+	}
+	return (v < 1) ? 1 : (v > MAX_SIZE) ? MAX_SIZE : (uint64_t)v;
+}
+
+/*
+ * emit - Write one request
+ */
+static void
+emit(int type, uint64_t id, uint64_t size)
+{
+	batch[nbatch].type = type;
+	batch[nbatch].index = id;
+	batch[nbatch].size = size;
+	nops++;
+	if (++nbatch == BATCH_OPS) {
+		if (fwrite(batch, sizeof(traceop_t), nbatch, body) !=
+		    (size_t)nbatch)
+			unix_error("write failed on", "the trace body");
+		nbatch = 0;
+	}
+}
+
+/*
+ * push_death, pop_death - Maintain the min-heap of deaths
+ */
+static void
+push_death(uint64_t death, uint64_t id)
+{
+	uint64_t i = ndeaths++, parent;
+
+	while (i > 0 && deaths[parent = (i - 1) / 2].death > death) {
+		deaths[i] = deaths[parent];
+		i = parent;
+	}
+	deaths[i].death = death;
+	deaths[i].id = id;
+}
+
+static death_t
+pop_death(void)
+{
+	death_t top = deaths[0], last = deaths[--ndeaths];
+	uint64_t i = 0, child;
+
+	while ((child = 2 * i + 1) < ndeaths) {
+		if (child + 1 < ndeaths &&
+		    deaths[child + 1].death < deaths[child].death)
+			child++;
+		if (deaths[child].death >= last.death)
+			break;
+		deaths[i] = deaths[child];
+		i = child;
+	}
+	deaths[i] = last;
+	return top;
+}
+
+/*
+ * free_next - Free the live block that dies first
+ */
+static void
+free_next(void)
+{
+	death_t d = pop_death();
+	uint64_t moved;
+
+	emit(FREE, d.id, 0);
+	live_bytes -= sizes[d.id];
+	moved = live[--nlive];
+	live[livepos[d.id]] = moved;
+	livepos[moved] = livepos[d.id];
+	freeids[nfreeids++] = d.id;
+}
+
+/*
+ * alloc_block - Allocate a new block that lives until request "death"
+ */
+static void
+alloc_block(uint64_t size, uint64_t death)
+{
+	uint64_t id;
+
+	if (nfreeids > 0)
+		id = freeids[--nfreeids];
+	else if ((id = nids++) == maxids) {
+		maxids = maxids ? 2 * maxids : 1024;
+		if ((sizes = realloc(sizes, maxids * sizeof(uint64_t))) ==
+			NULL ||
+		    (livepos = realloc(livepos, maxids * sizeof(uint64_t))) ==
+			NULL ||
+		    (live = realloc(live, maxids * sizeof(uint64_t))) == NULL ||
+		    (deaths = realloc(deaths, maxids * sizeof(death_t))) ==
+			NULL ||
+		    (freeids = realloc(freeids, maxids * sizeof(uint64_t))) ==
+			NULL)
+			unix_error("out of memory for", "the live blocks");
+	}
+	emit(ALLOC, id, size);
+	sizes[id] = size;
+	livepos[id] = nlive;
+	live[nlive++] = id;
+	push_death(death, id);
+	live_bytes += size;
+	if (live_bytes > peak_bytes)
+		peak_bytes = live_bytes;
+}
+
+/*
+ * realloc_block - Resize a random live block by the phase's factor, but
+ *     grow it no further than the phase's peak allows
+ */
+static void
+realloc_block(const phase_t *p)
+{
+	uint64_t id = live[next_random() % nlive];
+	double v = sizes[id] * p->realloc_by;
+	uint64_t size = (v < 1) ? 1 : (v > MAX_SIZE) ? MAX_SIZE : (uint64_t)v;
+	uint64_t others = live_bytes - sizes[id], room;
+
+	/*
+	 * If the other blocks are already over the peak, because an earlier
+	 * phase's was higher, the block keeps its size.
+	 */
+	if (p->peak > 0 && size > sizes[id]) {
+		room = (others < p->peak) ? p->peak - others : 0;
+		if (size > room)
+			size = (room > sizes[id]) ? room : sizes[id];
+	}
+	emit(REALLOC, id, size);
+	live_bytes += size - sizes[id];
+	sizes[id] = size;
+	if (live_bytes > peak_bytes)
+		peak_bytes = live_bytes;
+}
+
+/*
+ * generate - Generate the requests of every phase, then free what is left
+ */
+static void
+generate(void)
+{
+	const phase_t *p;
+	uint64_t end = 0, size;
+	int i;
+
+	for (i = 0; i < nphases; i++) {
+		p = &phases[i];
+		end += p->ops;
+		while (nops < end) {
+			if (ndeaths > 0 && deaths[0].death <= nops) {
+				free_next();
+				continue;
+			}
+			if (nlive > 0 && uniform() < p->realloc_prob) {
+				realloc_block(p);
+				continue;
+			}
+			size = draw(&p->size);
+			while (p->peak > 0 && nlive > 0 &&
+			    live_bytes + size > p->peak && nops < end)
+				free_next();
+			if (nops < end)
+				alloc_block(size, (p->lifetime.type == D_FOREVER) ?
+					FOREVER :
+					nops + draw(&p->lifetime));
+		}
+	}
+	while (ndeaths > 0)
+		free_next();
+	if (nbatch > 0 &&
+	    fwrite(batch, sizeof(traceop_t), nbatch, body) != (size_t)nbatch)
+		unix_error("write failed on", "the trace body");
+}
+
+/*
+ * parse_dist - Parse the distribution in the rest of a spec line
+ */
+static int
+parse_dist(char *rest, dist_t *d, int lifetime)
+{
+	char name[MAXLINE];
+	int n;
+
+	if (sscanf(rest, "%1023s %lf %lf", name, &d->a, &d->b) < 1)
+		return 0;
+	n = sscanf(rest, "%*s %lf %lf", &d->a, &d->b);
+	if (!strcmp(name, "fixed") && n == 1)
+		d->type = D_FIXED;
+	else if (!strcmp(name, "uniform") && n == 2 && d->a <= d->b)
+		d->type = D_UNIFORM;
+	else if (!strcmp(name, "lognormal") && n == 2 && !lifetime)
+		d->type = D_LOGNORMAL;
+	else if (!strcmp(name, "pow2") && n == 2 && d->a >= 1 &&
+	    d->a <= d->b && !lifetime)
+		d->type = D_POW2;
+	else if (!strcmp(name, "exp") && n == 1 && d->a > 0 && lifetime)
+		d->type = D_EXP;
+	else if (!strcmp(name, "forever") && n <= 0 && lifetime)
+		d->type = D_FOREVER;
+	else
+		return 0;
+	return 1;
+}
+
+/*
+ * read_spec - Read the workload declaration into phases[]
+ */
+static void
+read_spec(char *path)
+{
+	FILE *fp;
+	char line[MAXLINE], key[MAXLINE];
+	phase_t cur;
+	int lineno = 0, off;
+	unsigned long long n;
+	char *c;
+
+	memset(&cur, 0, sizeof(cur));
+	cur.size.type = D_FIXED;
+	cur.size.a = 64;
+	cur.lifetime.type = D_EXP;
+	cur.lifetime.a = 100;
+	cur.realloc_by = 1;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		unix_error("could not open", path);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if ((c = strchr(line, '#')) != NULL)
+			*c = '\0';
+		if (sscanf(line, "%1023s%n", key, &off) < 1)
+			continue;
+		if (!strcmp(key, "seed") &&
+		    sscanf(line + off, "%llu", &n) == 1 && n > 0) {
+			seed = n;
+		} else if (!strcmp(key, "phase") &&
+		    sscanf(line + off, "%llu", &n) == 1) {
+			if (nphases == MAXPHASES)
+				app_error("too many phases", path, lineno);
+			cur.ops = n;
+			nphases++;
+		} else if (!strcmp(key, "size")) {
+			if (!parse_dist(line + off, &cur.size, 0))
+				app_error("bad size distribution", path,
+				    lineno);
+		} else if (!strcmp(key, "lifetime")) {
+			if (!parse_dist(line + off, &cur.lifetime, 1))
+				app_error("bad lifetime distribution", path,
+				    lineno);
+		} else if (!strcmp(key, "realloc")) {
+			if (sscanf(line + off, "%lf %lf", &cur.realloc_prob,
+				&cur.realloc_by) != 2 ||
+			    cur.realloc_prob < 0 || cur.realloc_prob > 1 ||
+			    cur.realloc_by <= 0)
+				app_error("bad realloc setting", path, lineno);
+		} else if (!strcmp(key, "peak") &&
+		    sscanf(line + off, "%llu", &n) == 1) {
+			cur.peak = n;
+		} else
+			app_error("bad setting", path, lineno);
+
+		/* A setting after "phase" changes that phase */
+		if (nphases > 0)
+			phases[nphases - 1] = cur;
+	}
+	fclose(fp);
+	if (nphases == 0)
+		app_error("no phases declared", path, lineno);
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *out;
+	bintrace_hdr_t hdr;
+	size_t len, i, n;
+	int binary;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: tracegen <spec> <out.rep|out.bin>\n");
+		exit(1);
+	}
+	read_spec(argv[1]);
+
+	/* A binary trace is written in place, and its header last. */
+	len = strlen(argv[2]);
+	binary = len >= 4 && !strcmp(argv[2] + len - 4, ".bin");
+	if ((out = fopen(argv[2], "w")) == NULL)
+		unix_error("could not create", argv[2]);
+	if (binary) {
+		body = out;
+		if (fseek(out, sizeof(hdr), SEEK_SET) < 0)
+			unix_error("could not seek in", argv[2]);
+	} else if ((body = tmpfile()) == NULL)
+		unix_error("could not create a temporary file for", argv[2]);
+
+	generate();
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BINTRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINTRACE_VERSION;
+	hdr.op_size = sizeof(traceop_t);
+	hdr.sugg_heapsize = peak_bytes;
+	hdr.num_ids = nids;
+	hdr.num_ops = nops;
+	hdr.weight = 1;
+	if (binary) {
+		rewind(out);
+		if (fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+			unix_error("write failed on", argv[2]);
+	} else {
+		fprintf(out, "%" PRIu64 "\n%" PRIu64 "\n%" PRIu64 "\n%" PRIu64
+			     "\n",
+		    hdr.sugg_heapsize, hdr.num_ids, hdr.num_ops, hdr.weight);
+		rewind(body);
+		while ((n = fread(batch, sizeof(traceop_t), BATCH_OPS, body)) >
+		    0) {
+			for (i = 0; i < n; i++) {
+				if (batch[i].type == FREE)
+					fprintf(out, "f %" PRIu64 "\n",
+					    (uint64_t)batch[i].index);
+				else
+					fprintf(out, "%c %" PRIu64 " %" PRIu64
+						     "\n",
+					    (batch[i].type == ALLOC) ? 'a' : 'r',
+					    (uint64_t)batch[i].index,
+					    batch[i].size);
+			}
+		}
+		fclose(body);
+	}
+	if (fclose(out) != 0)
+		unix_error("close failed on", argv[2]);
+
+	printf("%s: %" PRIu64 " requests, %" PRIu64
+	       " blocks, peak live payload %" PRIu64 " bytes\n",
+	    argv[2], nops, nids, peak_bytes);
+	return (0);
+}